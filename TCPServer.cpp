@@ -7,14 +7,14 @@ using namespace my_muduo;
 std::string RequestStr(const HTTPRequest &req)
 {
     std::stringstream ss;
-    ss << req._method << " " << req._path << " " << req._version << "\r\n";
-    for (auto &it : req._params)
+    ss << req.MethodName() << " " << req._path << " " << req.VersionName() << "\r\n";
+    for (size_t i = 0; i < req.ParamCount(); i++)
     {
-        ss << it.first << ": " << it.second << "\r\n";
+        ss << req.ParamName(i) << ": " << req.ParamValue(i) << "\r\n";
     }
-    for (auto &it : req._headers)
+    for (size_t i = 0; i < req.HeaderCount(); i++)
     {
-        ss << it.first << ": " << it.second << "\r\n";
+        ss << req.HeaderName(i).ToString() << ": " << req.HeaderValue(i).ToString() << "\r\n";
     }
     ss << "\r\n";
     ss << req._body;
@@ -31,10 +31,44 @@ void Login(const HTTPRequest &req, HTTPResponse *rsp)
     rsp->SetContent(RequestStr(req), "text/plain");
 }
 
-void PutFile(const HTTPRequest &req, HTTPResponse *rsp)
+// 正文到来之前打开文件，正文边收边写入，不在内存中保存整个文件
+void PutFileStart(HTTPRequest &req, HTTPResponse *rsp)
 {
     std::string pathname = WWWROOT + req._path;
-    Util::WriteFile(pathname, req._body);
+    std::shared_ptr<HTTPBodySink> sink = HTTPBodySink::File(pathname);
+    if (sink == nullptr)
+    {
+        rsp->_statu = 500;
+        return;
+    }
+    req.SetBodySink(sink);
+}
+
+void PutFile(const HTTPRequest &req, HTTPResponse *rsp)
+{
+    rsp->SetContent(std::to_string(req.BodySink()->Received()) + " bytes saved\n", "text/plain");
+}
+
+// multipart表单上传：文件部分逐个写入静态资源目录，其他字段丢弃
+void UploadStart(HTTPRequest &req, HTTPResponse *rsp)
+{
+    std::shared_ptr<HTTPMultipart> form = HTTPMultipart::Create(req, [](const MultipartPart &part) -> std::shared_ptr<HTTPBodySink> {
+        std::string filename = part.filename.substr(part.filename.find_last_of("/\\") + 1);
+        if (filename.empty() || Util::ValidPath("/" + filename) == false)
+            return nullptr;
+        return HTTPBodySink::File(WWWROOT + filename);
+    });
+    if (form == nullptr)
+    {
+        rsp->_statu = 400;
+        return;
+    }
+    req.SetBodySink(form->Sink());
+}
+
+void Upload(const HTTPRequest &req, HTTPResponse *rsp)
+{
+    rsp->SetContent(std::to_string(req.BodySink()->Received()) + " bytes uploaded\n", "text/plain");
 }
 
 void DelFile(const HTTPRequest &req, HTTPResponse *rsp)
@@ -49,7 +83,10 @@ int main()
     server.SetBaseDir(WWWROOT); // 设置静态资源根目录，告诉服务器有静态资源请求到来，需要到哪里去找资源文件
     server.Get("/hello", Hello);
     server.Post("/login", Login);
+    server.HandleBodyStart(HTTP_PUT, "/1234.txt", PutFileStart);
     server.Put("/1234.txt", PutFile);
+    server.HandleBodyStart(HTTP_POST, "/upload", UploadStart);
+    server.Post("/upload", Upload);
     server.Delete("/1234.txt", DelFile);
     server.Listen();
     return 0;
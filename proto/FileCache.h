@@ -0,0 +1,169 @@
+#pragma once
+
+#include "OpenFileCache.h"
+#include <list>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+
+namespace my_muduo
+{
+#define FILE_CACHE_MAX_BYTES (64 << 20) // 缓存占用内存的默认上限
+#define FILE_CACHE_MAX_FILE (1 << 20)   // 超过这个大小的文件不缓存内容，直接从描述符发送
+
+    // 缓存的文件内容，创建之后不再修改，多个连接可以同时持有并发送
+    struct FileEntry
+    {
+        std::shared_ptr<const std::string> body; // 文件内容
+        std::string headers;                     // 预先组织好的完整文件响应的头部，包含\r\n
+        struct stat st;                          // 读取内容时文件的属性
+    };
+
+    /* 静态文件内容的LRU缓存：
+     * 以实际文件路径为键，文件是否变化由打开文件缓存中的stat结果判断，这里不再访问文件系统；
+     * 文件变化了才通过已经打开的描述符重新读取；
+     * 多个loop线程共用一个缓存，锁内只做查找和链表调整，读文件在锁外进行。 */
+    class FileCache
+    {
+    private:
+        struct Node
+        {
+            std::string path;
+            std::shared_ptr<const FileEntry> entry;
+        };
+        using NodeList = std::list<Node>;
+
+        std::mutex _mutex;
+        NodeList _lru; // 越靠前越是最近使用的
+        std::unordered_map<std::string, NodeList::iterator> _index;
+        size_t _bytes;     // 当前缓存的数据总量
+        size_t _max_bytes; // 缓存的数据总量上限，为0时关闭缓存
+        size_t _max_file;  // 单个文件的大小上限
+        uint64_t _hits;
+        uint64_t _misses;
+
+    private:
+        static size_t Cost(const Node &node)
+        {
+            return node.path.size() + node.entry->body->size() + node.entry->headers.size();
+        }
+
+        static std::shared_ptr<const FileEntry> Load(const OpenFile &file)
+        {
+            std::shared_ptr<std::string> body = std::make_shared<std::string>(file.st.st_size, '\0');
+            size_t total = 0;
+            while (total < body->size())
+            {
+                ssize_t ret = pread(file.fd, &(*body)[total], body->size() - total, total);
+                if (ret < 0 && errno == EINTR)
+                    continue;
+                if (ret <= 0)
+                {
+                    LOGE("read %s failed!", file.path.c_str());
+                    return nullptr;
+                }
+                total += ret;
+            }
+            std::shared_ptr<FileEntry> entry = std::make_shared<FileEntry>();
+            entry->body = body;
+            entry->headers = file.headers;
+            entry->st = file.st;
+            return entry;
+        }
+
+        // 删除节点，调用时需要持有锁
+        void Erase(NodeList::iterator it)
+        {
+            _bytes -= Cost(*it);
+            _index.erase(it->path);
+            _lru.erase(it);
+        }
+
+        // 插入或替换节点，超出上限时从最久未使用的开始淘汰，调用时需要持有锁
+        void Insert(const std::string &path, const std::shared_ptr<const FileEntry> &entry)
+        {
+            auto it = _index.find(path);
+            if (it != _index.end())
+                Erase(it->second);
+            _lru.push_front(Node{path, entry});
+            _index[path] = _lru.begin();
+            _bytes += Cost(_lru.front());
+            while (_bytes > _max_bytes && _lru.empty() == false)
+                Erase(std::prev(_lru.end()));
+        }
+
+    public:
+        FileCache(size_t max_bytes = FILE_CACHE_MAX_BYTES)
+            : _bytes(0), _max_bytes(max_bytes), _max_file(std::min<size_t>(max_bytes, FILE_CACHE_MAX_FILE)),
+              _hits(0), _misses(0) {}
+
+        /**
+         * @brief 修改缓存的内存上限，已经缓存的内容超出新上限时立即淘汰
+         * @param max_bytes[in]  缓存的数据总量上限，为0时关闭缓存
+         * @return 空
+         */
+        void Config(size_t max_bytes)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _max_bytes = max_bytes;
+            _max_file = std::min<size_t>(max_bytes, FILE_CACHE_MAX_FILE);
+            while (_bytes > _max_bytes && _lru.empty() == false)
+                Erase(std::prev(_lru.end()));
+        }
+
+        /**
+         * @brief 查找文件内容
+         * @param file[in]       打开文件缓存中的文件，缓存的内容与它的属性不一致时重新读取
+         * @return 缓存的文件内容，文件太大不缓存或者读取失败时为空
+         */
+        std::shared_ptr<const FileEntry> Lookup(const OpenFile &file)
+        {
+            size_t max_file;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                max_file = _max_file;
+                auto it = _index.find(file.path);
+                if (it != _index.end())
+                {
+                    if (file.Same(it->second->entry->st))
+                    {
+                        _lru.splice(_lru.begin(), _lru, it->second);
+                        _hits++;
+                        return it->second->entry;
+                    }
+                    Erase(it->second);
+                }
+            }
+            if ((size_t)file.st.st_size > max_file)
+                return nullptr;
+            std::shared_ptr<const FileEntry> loaded = Load(file);
+            std::unique_lock<std::mutex> lock(_mutex);
+            _misses++;
+            if (loaded)
+                Insert(file.path, loaded);
+            return loaded;
+        }
+
+        uint64_t Hits()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _hits;
+        }
+        uint64_t Misses()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _misses;
+        }
+        // 当前缓存的数据总量
+        size_t Bytes()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _bytes;
+        }
+        size_t Count()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _lru.size();
+        }
+    };
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "Log.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <string>
+#include <memory>
+#include <functional>
+
+namespace my_muduo
+{
+    /* 请求正文接收器：在正文开始处理函数中通过 HTTPRequest::SetBodySink 设置，
+     * 正文边收边交给接收器，不再保存到 HTTPRequest::_body，内存占用与正文大小无关。
+     * 写入文件的接收器在正文长度已知时，套接字中还没有读取的正文直接splice到文件，不经过用户空间。 */
+    class HTTPBodySink
+    {
+    public:
+        using WriteCallBack = std::function<bool(const char *, size_t)>;
+        using FinishCallBack = std::function<bool()>;
+
+    private:
+        WriteCallBack _write;   // 收到一段正文，返回false时中止请求
+        FinishCallBack _finish; // 正文接收完毕，返回false时应答500
+        int _fd;                // 文件接收器打开的文件
+        size_t _received;       // 已经接收的正文长度
+
+    public:
+        /**
+         * @brief 回调接收器
+         * @param write[in]      收到一段正文时调用，数据只在调用期间有效，返回false时中止请求并应答500
+         * @param finish[in]     正文接收完毕时调用，可以为空
+         */
+        HTTPBodySink(const WriteCallBack &write, const FinishCallBack &finish = nullptr)
+            : _write(write), _finish(finish), _fd(-1), _received(0) {}
+        ~HTTPBodySink()
+        {
+            if (_fd >= 0)
+                close(_fd);
+        }
+        HTTPBodySink(const HTTPBodySink &) = delete;
+        HTTPBodySink &operator=(const HTTPBodySink &) = delete;
+
+        /**
+         * @brief 创建写入文件的接收器，文件已经存在时清空
+         * @param path[in]       文件路径
+         * @param finish[in]     正文全部写入文件之后调用，可以为空
+         * @return 打开文件失败时返回空
+         */
+        static std::shared_ptr<HTTPBodySink> File(const std::string &path, const FinishCallBack &finish = nullptr)
+        {
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0)
+            {
+                LOGE("open %s failed!", path.c_str());
+                return nullptr;
+            }
+            std::shared_ptr<HTTPBodySink> sink = std::make_shared<HTTPBodySink>(nullptr, finish);
+            sink->_fd = fd;
+            return sink;
+        }
+
+        // 交给接收器一段正文
+        bool Write(const char *data, size_t len)
+        {
+            _received += len;
+            if (_fd < 0)
+                return _write(data, len);
+            while (len > 0)
+            {
+                ssize_t ret = write(_fd, data, len);
+                if (ret < 0 && errno == EINTR)
+                    continue;
+                if (ret <= 0)
+                {
+                    LOGE("write body to file failed!");
+                    return false;
+                }
+                data += ret;
+                len -= ret;
+            }
+            return true;
+        }
+        // 正文接收完毕
+        bool Finish() { return _finish ? _finish() : true; }
+
+        // 可以直接转存正文的描述符，回调接收器返回-1
+        int SpliceFd() const { return _fd; }
+        // 已经直接转存到描述符的长度
+        void Spliced(size_t len) { _received += len; }
+        size_t Received() const { return _received; }
+    };
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <zlib.h>
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace my_muduo
+{
+#define COMPRESS_LEVEL 6    // 压缩级别，兼顾压缩率和CPU
+#define COMPRESS_POOL_MAX 8 // 每个线程每种编码最多保留的空闲压缩器个数
+
+    typedef enum
+    {
+        COMPRESS_GZIP,    // Content-Encoding: gzip
+        COMPRESS_DEFLATE, // Content-Encoding: deflate（zlib格式）
+        COMPRESS_NONE
+    } CompressType;
+
+    // 流式压缩器，一次压缩一个完整的响应正文，Reset之后可以重复使用
+    class Deflater
+    {
+    private:
+        z_stream _zs;
+        CompressType _type;
+
+        // 压缩数据追加到out后面，输出空间不够时扩容
+        bool Run(const char *data, size_t len, std::string *out, int flush)
+        {
+            _zs.next_in = (Bytef *)data;
+            _zs.avail_in = len;
+            size_t start = out->size();
+            do
+            {
+                size_t used = out->size();
+                size_t room = std::max<size_t>(deflateBound(&_zs, _zs.avail_in), 256);
+                out->resize(used + room);
+                _zs.next_out = (Bytef *)&(*out)[used];
+                _zs.avail_out = room;
+                int ret = deflate(&_zs, flush);
+                out->resize(used + room - _zs.avail_out);
+                if (ret == Z_STREAM_ERROR)
+                {
+                    out->resize(start);
+                    return false;
+                }
+                if (ret == Z_STREAM_END)
+                    break;
+            } while (_zs.avail_out == 0 || _zs.avail_in > 0 || (flush == Z_FINISH));
+            return true;
+        }
+
+    public:
+        Deflater(CompressType type) : _type(type)
+        {
+            memset(&_zs, 0, sizeof(_zs));
+            // windowBits 加16输出gzip格式，否则输出zlib格式
+            int ret = deflateInit2(&_zs, COMPRESS_LEVEL, Z_DEFLATED, type == COMPRESS_GZIP ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY);
+            assert(ret == Z_OK);
+            (void)ret;
+        }
+        ~Deflater() { deflateEnd(&_zs); }
+        Deflater(const Deflater &) = delete;
+        Deflater &operator=(const Deflater &) = delete;
+
+        CompressType Type() const { return _type; }
+        // 重置压缩状态，保留已经分配的内存
+        void Reset() { deflateReset(&_zs); }
+
+        /**
+         * @brief 压缩一段数据
+         * @param data[in]       数据
+         * @param len[in]        数据长度
+         * @param out[out]       压缩后的数据追加到out后面
+         * @param flush[in]      为true时输出目前为止的全部压缩数据，流式发送的每一块数据都需要flush
+         * @return 成功返回true
+         */
+        bool Update(const char *data, size_t len, std::string *out, bool flush = false)
+        {
+            return Run(data, len, out, flush ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+        }
+
+        /**
+         * @brief 结束压缩，输出剩余的数据和结尾（gzip的校验和长度）
+         * @param out[out]       压缩后的数据追加到out后面
+         * @return 成功返回true
+         */
+        bool Finish(std::string *out)
+        {
+            return Run(nullptr, 0, out, Z_FINISH);
+        }
+    };
+
+    // 每个loop线程保存一些用过的压缩器，重置后重复使用，避免每个响应都分配和初始化压缩器（每个约数百KB）
+    class DeflaterPool
+    {
+    private:
+        static std::vector<std::unique_ptr<Deflater>> &Free(CompressType type)
+        {
+            thread_local std::vector<std::unique_ptr<Deflater>> free[COMPRESS_NONE];
+            return free[type];
+        }
+
+    public:
+        // 取出一个压缩器，没有空闲的时候新建
+        static std::unique_ptr<Deflater> Get(CompressType type)
+        {
+            std::vector<std::unique_ptr<Deflater>> &free = Free(type);
+            if (free.empty())
+                return std::unique_ptr<Deflater>(new Deflater(type));
+            std::unique_ptr<Deflater> deflater = std::move(free.back());
+            free.pop_back();
+            return deflater;
+        }
+        // 归还压缩器，必须在取出它的线程中调用
+        static void Put(std::unique_ptr<Deflater> deflater)
+        {
+            std::vector<std::unique_ptr<Deflater>> &free = Free(deflater->Type());
+            if (free.size() >= COMPRESS_POOL_MAX)
+                return;
+            deflater->Reset();
+            free.push_back(std::move(deflater));
+        }
+
+        /**
+         * @brief 压缩完整的数据
+         * @param type[in]       压缩格式
+         * @param data[in]       原始数据
+         * @param out[out]       压缩后的数据
+         * @return 成功返回true
+         */
+        static bool Compress(CompressType type, const std::string &data, std::string *out)
+        {
+            std::unique_ptr<Deflater> deflater = Get(type);
+            out->clear();
+            out->reserve(deflateBound(nullptr, data.size()));
+            bool ret = deflater->Update(data.data(), data.size(), out) && deflater->Finish(out);
+            Put(std::move(deflater));
+            return ret;
+        }
+    };
+}
@@ -3,12 +3,13 @@
 #include "TCPServer.h"
 #include "HTTPRequest.h"
 #include "HTTPResponse.h"
+#include "HTTPResponder.h"
+#include "HTTPParser.h"
 #include "Util.h"
+#include <vector>
 
 namespace my_muduo
 {
-#define MAX_LINE 8192
-
     typedef enum
     {
         RECV_HTTP_ERROR,
@@ -18,189 +19,341 @@ namespace my_muduo
         RECV_HTTP_OVER
     } HttpRecvStatu;
 
+    // 分块传输正文的解析阶段
+    typedef enum
+    {
+        CHUNK_SIZE,     // 分块大小行
+        CHUNK_DATA,     // 分块数据
+        CHUNK_DATA_END, // 分块数据之后的CRLF
+        CHUNK_TRAILER   // 最后一个分块之后的尾部字段，直到空行
+    } ChunkStatu;
+
     class HTTPContext
     {
     private:
         int _resp_statu;           // 响应状态码
         HttpRecvStatu _recv_statu; // 当前接收及解析的阶段状态
         HTTPRequest _request;      // 已经解析得到的请求信息
+        HTTPParser _parser;        // 请求行和头部的增量解析器
+        size_t _pending;           // 请求仍然引用的、处理完后需要从缓冲区移除的数据长度
+        std::shared_ptr<HTTPStream> _stream; // 正在流式发送的响应，发送结束之前暂停处理后续的请求
+        size_t _max_body;          // 正文长度上限，为0时不限制
+        size_t _head_len;          // 请求行加头部的长度，正文开始之前头部仍然在缓冲区中
+        bool _head_ready;          // 头部已经接收完毕，等待服务器调用StartBody开始接收正文
+        bool _chunked;             // 正文使用分块传输
+        ChunkStatu _chunk_statu;   // 分块传输的解析阶段
+        size_t _remaining;         // 正文（或当前分块）还没有接收的长度
+        size_t _received;          // 已经接收的正文长度
+        // 按请求顺序排队的应答，_queue_head处是还没有发送的最早的应答
+        // 不用std::deque：它的移动构造不是noexcept，HTTPContext会因此放不进连接上下文的内联存储
+        std::vector<PtrResponder> _queue;
+        size_t _queue_head;
+        bool _closing;             // 排队的应答中有需要关闭连接的，之后的请求不再处理
     private:
-        bool ParseHttpLine(const std::string &line)
+        bool Fail(int statu)
         {
-            std::smatch matches;
-            std::regex e("(GET|HEAD|POST|PUT|DELETE) ([^?]*)(?:\\?(.*))? (HTTP/1\\.[01])(?:\n|\r\n)?", std::regex::icase);
-            bool ret = std::regex_match(line, matches, e);
-            if (ret == false)
-            {
-                _recv_statu = RECV_HTTP_ERROR;
-                _resp_statu = 400; // BAD REQUEST
-                return false;
-            }
-            // 0 : GET /bitejiuyeke/login?user=xiaoming&pass=123123 HTTP/1.1
-            // 1 : GET
-            // 2 : /bitejiuyeke/login
-            // 3 : user=xiaoming&pass=123123
-            // 4 : HTTP/1.1
-            // 请求方法的获取
-            _request._method = matches[1];
-            std::transform(_request._method.begin(), _request._method.end(), _request._method.begin(), ::toupper);
-            // 资源路径的获取，需要进行URL解码操作，但是不需要+转空格
-            _request._path = Util::UrlDecode(matches[2], false);
-            // 协议版本的获取
-            _request._version = matches[4];
-            // 查询字符串的获取与处理
-            std::vector<std::string> query_string_arry;
-            std::string query_string = matches[3];
-            // 查询字符串的格式 key=val&key=val....., 先以 & 符号进行分割，得到各个字串
-            Util::Split(query_string, "&", &query_string_arry);
-            // 针对各个字串，以 = 符号进行分割，得到key 和val， 得到之后也需要进行URL解码
-            for (auto &str : query_string_arry)
-            {
-                size_t pos = str.find("=");
-                if (pos == std::string::npos)
-                {
-                    _recv_statu = RECV_HTTP_ERROR;
-                    _resp_statu = 400; // BAD REQUEST
-                    return false;
-                }
-                std::string key = Util::UrlDecode(str.substr(0, pos), true);
-                std::string val = Util::UrlDecode(str.substr(pos + 1), true);
-                _request.SetParam(key, val);
-            }
-            return true;
+            _recv_statu = RECV_HTTP_ERROR;
+            _resp_statu = statu;
+            return false;
         }
-        bool RecvHttpLine(Buffer *buf)
+        // 接收并解析请求行和头部，数据不足时保留在缓冲区中，下次从上次解析到的位置继续
+        bool RecvHttpHead(Buffer *buf)
         {
-            if (_recv_statu != RECV_HTTP_LINE)
+            if (_recv_statu != RECV_HTTP_LINE && _recv_statu != RECV_HTTP_HEAD)
                 return false;
-            // 1. 获取一行数据，带有末尾的换行
-            std::string line = buf->GetLineAndPop();
-            // 2. 需要考虑的一些要素：缓冲区中的数据不足一行， 获取的一行数据超大
-            if (line.size() == 0)
+            const char *data = buf->ReadPosition();
+            HttpParseResult ret = _parser.Execute(data, buf->ReadAbleSize());
+            if (ret == PARSE_ERROR)
+                return Fail(_parser.ErrorStatu());
+            if (ret == PARSE_AGAIN)
             {
-                // 缓冲区中的数据不足一行，则需要判断缓冲区的可读数据长度，如果很长了都不足一行，这是有问题的
-                if (buf->ReadAbleSize() > MAX_LINE)
-                {
-                    _recv_statu = RECV_HTTP_ERROR;
-                    _resp_statu = 414; // URI TOO LONG
-                    return false;
-                }
-                // 缓冲区中数据不足一行，但是也不多，就等等新数据的到来
+                if (_parser.LineDone())
+                    _recv_statu = RECV_HTTP_HEAD;
                 return true;
             }
-            if (line.size() > MAX_LINE)
+            if (_request.SetHead(data, _parser) == false)
+                return Fail(400); // BAD REQUEST
+            _head_len = _parser.HeadLength();
+            // 只支持单独的chunked传输编码；同时带有Content-Length时无法确定正文边界，直接拒绝
+            HTTPView te = _request.Header(HEADER_TRANSFER_ENCODING);
+            _chunked = te.Empty() == false;
+            if (_chunked && (_request._version == HTTP_1_0 || _parser.ContentLength() >= 0))
+                return Fail(400);
+            if (_chunked && te.EqualNoCase("chunked") == false)
+                return Fail(501); // Not Implemented
+            if (_max_body > 0 && _request.ContentLength() > _max_body)
+                return Fail(413); // Payload Too Large
+            _parser.Reset();
+            // 头部处理完毕，进入正文获取阶段
+            _recv_statu = RECV_HTTP_BODY;
+            if (_chunked == false && _request.ContentLength() == 0)
             {
-                _recv_statu = RECV_HTTP_ERROR;
-                _resp_statu = 414; // URI TOO LONG
-                return false;
+                // 没有正文：请求直接引用缓冲区中的头部，处理完后再移除
+                _pending = _head_len;
+                _recv_statu = RECV_HTTP_OVER;
+                return true;
             }
-            bool ret = ParseHttpLine(line);
-            if (ret == false)
+            // 有正文时先交给服务器决定正文的去向（接收器、拒绝、100-continue）
+            _head_ready = true;
+            return true;
+        }
+
+        // 收到一段正文，交给接收器或者保存到请求中
+        bool Deliver(const char *data, size_t len)
+        {
+            _received += len;
+            if (_max_body > 0 && _received > _max_body)
+                return Fail(413);
+            const std::shared_ptr<HTTPBodySink> &sink = _request.BodySink();
+            if (sink == nullptr)
+                _request._body.append(data, len);
+            else if (sink->Write(data, len) == false)
+                return Fail(500);
+            return true;
+        }
+        // 正文接收完毕
+        bool FinishBody()
+        {
+            const std::shared_ptr<HTTPBodySink> &sink = _request.BodySink();
+            if (sink && sink->Finish() == false)
+                return Fail(500);
+            _recv_statu = RECV_HTTP_OVER;
+            return true;
+        }
+
+        // 取出缓冲区开头的一行（不含行尾的CRLF），没有完整的一行时返回false
+        static bool TakeLine(Buffer *buf, std::string *line, bool *error)
+        {
+            size_t len = std::min<size_t>(buf->ReadAbleSize(), MAX_LINE);
+            const char *data = buf->ReadPosition();
+            const char *lf = (const char *)memchr(data, '\n', len);
+            if (lf == nullptr)
             {
+                *error = buf->ReadAbleSize() >= MAX_LINE;
                 return false;
             }
-            // 首行处理完毕，进入头部获取阶段
-            _recv_statu = RECV_HTTP_HEAD;
+            size_t end = lf - data;
+            line->assign(data, end > 0 && data[end - 1] == '\r' ? end - 1 : end);
+            buf->MoveReadOffset(end + 1);
             return true;
         }
-        bool RecvHttpHead(Buffer *buf)
+
+        // 分块传输：大小行（十六进制，可以带;扩展）、数据、CRLF，最后是大小为0的分块和可选的尾部字段
+        bool RecvChunkedBody(Buffer *buf)
         {
-            if (_recv_statu != RECV_HTTP_HEAD)
-                return false;
-            // 一行一行取出数据，直到遇到空行为止， 头部的格式 key: val\r\nkey: val\r\n....
-            while (1)
+            std::string line;
+            bool error = false;
+            while (_recv_statu == RECV_HTTP_BODY)
             {
-                std::string line = buf->GetLineAndPop();
-                // 2. 需要考虑的一些要素：缓冲区中的数据不足一行， 获取的一行数据超大
-                if (line.size() == 0)
+                switch (_chunk_statu)
+                {
+                case CHUNK_SIZE:
                 {
-                    // 缓冲区中的数据不足一行，则需要判断缓冲区的可读数据长度，如果很长了都不足一行，这是有问题的
-                    if (buf->ReadAbleSize() > MAX_LINE)
+                    if (TakeLine(buf, &line, &error) == false)
+                        return error ? Fail(400) : true;
+                    size_t size = 0, i = 0;
+                    for (; i < line.size() && isxdigit((unsigned char)line[i]); i++)
                     {
-                        _recv_statu = RECV_HTTP_ERROR;
-                        _resp_statu = 414; // URI TOO LONG
-                        return false;
+                        if (size >> 56)
+                            return Fail(400); // 分块大小溢出
+                        size = size * 16 + (isdigit((unsigned char)line[i]) ? line[i] - '0' : (tolower(line[i]) - 'a' + 10));
                     }
-                    // 缓冲区中数据不足一行，但是也不多，就等等新数据的到来
-                    return true;
+                    if (i == 0 || (i < line.size() && line[i] != ';' && line[i] != ' ' && line[i] != '\t'))
+                        return Fail(400);
+                    _remaining = size;
+                    _chunk_statu = size == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+                    break;
                 }
-                if (line.size() > MAX_LINE)
+                case CHUNK_DATA:
                 {
-                    _recv_statu = RECV_HTTP_ERROR;
-                    _resp_statu = 414; // URI TOO LONG
-                    return false;
+                    size_t len = std::min<size_t>(buf->ReadAbleSize(), _remaining);
+                    if (len == 0)
+                        return true;
+                    if (Deliver(buf->ReadPosition(), len) == false)
+                        return false;
+                    buf->MoveReadOffset(len);
+                    _remaining -= len;
+                    if (_remaining == 0)
+                        _chunk_statu = CHUNK_DATA_END;
+                    break;
                 }
-                if (line == "\n" || line == "\r\n")
+                case CHUNK_DATA_END:
+                    if (TakeLine(buf, &line, &error) == false)
+                        return error ? Fail(400) : true;
+                    if (line.empty() == false)
+                        return Fail(400);
+                    _chunk_statu = CHUNK_SIZE;
                     break;
-                
-                bool ret = ParseHttpHead(line);
-                if (ret == false)
-                    return false;
-                
-            }
-            // 头部处理完毕，进入正文获取阶段
-            _recv_statu = RECV_HTTP_BODY;
-            return true;
-        }
-        bool ParseHttpHead(std::string &line)
-        {
-            // key: val\r\nkey: val\r\n....
-            if (line.back() == '\n')
-                line.pop_back(); // 末尾是换行则去掉换行字符
-            if (line.back() == '\r')
-                line.pop_back(); // 末尾是回车则去掉回车字符
-            size_t pos = line.find(": ");
-            if (pos == std::string::npos)
-            {
-                _recv_statu = RECV_HTTP_ERROR;
-                _resp_statu = 400; //
-                return false;
+                case CHUNK_TRAILER:
+                    // 尾部字段直接忽略，空行表示正文结束
+                    if (TakeLine(buf, &line, &error) == false)
+                        return error ? Fail(400) : true;
+                    if (line.empty())
+                        return FinishBody();
+                    break;
+                }
             }
-            std::string key = line.substr(0, pos);
-            std::string val = line.substr(pos + 2);
-            _request.SetHeader(key, val);
             return true;
         }
+
         bool RecvHttpBody(Buffer *buf)
         {
-            if (_recv_statu != RECV_HTTP_BODY)
+            if (_recv_statu != RECV_HTTP_BODY || _head_ready)
                 return false;
-            // 1. 获取正文长度
-            size_t content_length = _request.ContentLength();
-            if (content_length == 0)
+            if (_chunked)
+                return RecvChunkedBody(buf);
+            // 缓冲区中有多少取多少，剩余的正文等待新数据到来
+            size_t len = std::min<size_t>(buf->ReadAbleSize(), _remaining);
+            if (len > 0)
             {
-                // 没有正文，则请求接收解析完毕
-                _recv_statu = RECV_HTTP_OVER;
-                return true;
-            }
-            // 2. 当前已经接收了多少正文,其实就是往  _request._body 中放了多少数据了
-            size_t real_len = content_length - _request._body.size(); // 实际还需要接收的正文长度
-            // 3. 接收正文放到body中，但是也要考虑当前缓冲区中的数据，是否是全部的正文
-            //   3.1 缓冲区中数据，包含了当前请求的所有正文，则取出所需的数据
-            if (buf->ReadAbleSize() >= real_len)
-            {
-                _request._body.append(buf->ReadPosition(), real_len);
-                buf->MoveReadOffset(real_len);
-                _recv_statu = RECV_HTTP_OVER;
-                return true;
+                if (Deliver(buf->ReadPosition(), len) == false)
+                    return false;
+                buf->MoveReadOffset(len);
+                _remaining -= len;
             }
-            //  3.2 缓冲区中数据，无法满足当前正文的需要，数据不足，取出数据，然后等待新数据到来
-            _request._body.append(buf->ReadPosition(), buf->ReadAbleSize());
-            buf->MoveReadOffset(buf->ReadAbleSize());
+            if (_remaining == 0)
+                return FinishBody();
             return true;
         }
 
     public:
-        HTTPContext() : _resp_statu(200), _recv_statu(RECV_HTTP_LINE) {}
+        HTTPContext(size_t max_body = 0)
+            : _resp_statu(200), _recv_statu(RECV_HTTP_LINE), _pending(0), _max_body(max_body), _head_len(0),
+              _head_ready(false), _chunked(false), _chunk_statu(CHUNK_SIZE), _remaining(0), _received(0), _queue_head(0), _closing(false) {}
         void ReSet()
         {
             _resp_statu = 200;
+            _pending = 0;
+            _head_len = 0;
+            _head_ready = false;
+            _chunked = false;
+            _chunk_statu = CHUNK_SIZE;
+            _remaining = 0;
+            _received = 0;
             _recv_statu = RECV_HTTP_LINE;
             _request.ReSet();
+            _parser.Reset();
         }
         int RespStatu() { return _resp_statu; }
         HttpRecvStatu RecvStatu() { return _recv_statu; }
         HTTPRequest &Request() { return _request; }
+        // 是否有正在流式发送的响应
+        bool Streaming() { return _stream != nullptr; }
+        void SetStream(const std::shared_ptr<HTTPStream> &stream) { _stream = stream; }
+        // 连接关闭时调用，丢弃正在流式发送的响应
+        void AbortStream()
+        {
+            if (_stream)
+                _stream->Abort();
+            _stream.reset();
+        }
+        // 是否有排队等待发送的应答，这时后续请求的应答也需要排队
+        bool Queued() { return _queue_head < _queue.size(); }
+        size_t QueueSize() { return _queue.size() - _queue_head; }
+        bool Closing() { return _closing; }
+        /**
+         * @brief 把当前请求移动到应答中排队，并从缓冲区中移除请求，之后可以继续接收下一个请求
+         * @param responder[in]  保存请求和响应的应答
+         * @param buf[in]        输入缓冲区
+         * @return 空
+         */
+        void Enqueue(const PtrResponder &responder, Buffer *buf)
+        {
+            _request.MoveTo(&responder->MutableRequest());
+            Finish(buf);
+            if (responder->Close() || responder->Request().Close())
+                _closing = true;
+            _queue.push_back(responder);
+        }
+        // 队首的应答已经完成时取出，否则返回空
+        PtrResponder Dequeue()
+        {
+            if (Queued() == false || _queue[_queue_head]->Finished() == false)
+                return nullptr;
+            PtrResponder responder = std::move(_queue[_queue_head++]);
+            // 队列取空时整体清空，队列长度受HTTP_PIPELINE_MAX限制，不会无限增长
+            if (_queue_head == _queue.size())
+            {
+                _queue.clear();
+                _queue_head = 0;
+            }
+            return responder;
+        }
+        // 连接关闭，丢弃排队的应答，异步处理函数之后调用Done不再发送
+        void AbortQueue()
+        {
+            _queue.clear();
+            _queue_head = 0;
+            _closing = true;
+        }
+
+        // 请求处理完毕：从缓冲区中移除请求引用的数据，准备接收下一个请求
+        void Finish(Buffer *buf)
+        {
+            buf->MoveReadOffset(_pending);
+            ReSet();
+        }
+        // 头部已经接收完毕，请求带有正文，等待服务器决定正文的去向
+        bool HeadReady() { return _head_ready; }
+        // 请求带有分块传输的正文
+        bool Chunked() { return _chunked; }
+
+        /**
+         * @brief 开始接收正文，在HeadReady之后由服务器调用，正文接收器需要在这之前设置好
+         * @param buf[in]        输入缓冲区，开头仍然是请求的头部
+         * @return 空
+         */
+        void StartBody(Buffer *buf)
+        {
+            _head_ready = false;
+            size_t cl = _request.ContentLength();
+            if (_chunked == false && _request.BodySink() == nullptr && buf->ReadAbleSize() - _head_len >= cl)
+            {
+                // 正文已经完整：头部仍然引用缓冲区中的数据，正文拷贝到请求中，处理完后再一起从缓冲区移除
+                _request._body.assign(buf->ReadPosition() + _head_len, cl);
+                _pending = _head_len + cl;
+                _received = cl;
+                _recv_statu = RECV_HTTP_OVER;
+                return;
+            }
+            // 正文还没有收全或者交给接收器：把头部拷贝到请求中，移除头部，正文边收边取
+            _request.Own();
+            buf->MoveReadOffset(_head_len);
+            _remaining = _chunked ? 0 : cl;
+            RecvHttpBody(buf);
+        }
+
+        /**
+         * @brief 缓冲区中的正文已经取完，剩余的正文可以从套接字直接转存到接收器的文件时返回文件描述符
+         * @param buf[in]        输入缓冲区
+         * @param min[in]        剩余正文不小于这个长度才转存，太小时不值得创建管道
+         * @return 文件描述符，不能转存时返回-1
+         */
+        int SpliceFd(Buffer *buf, size_t min)
+        {
+            const std::shared_ptr<HTTPBodySink> &sink = _request.BodySink();
+            if (_recv_statu != RECV_HTTP_BODY || _head_ready || _chunked || sink == nullptr || buf->ReadAbleSize() > 0)
+                return -1;
+            return _remaining >= min ? sink->SpliceFd() : -1;
+        }
+        // 剩余正文的长度
+        size_t BodyRemaining() { return _remaining; }
+        // 剩余正文转存结束，len为转存的长度
+        void Spliced(size_t len, bool ok)
+        {
+            if (_recv_statu != RECV_HTTP_BODY)
+                return;
+            _request.BodySink()->Spliced(len);
+            _received += len;
+            _remaining -= std::min(len, _remaining);
+            if (ok == false || _remaining > 0)
+            {
+                Fail(500);
+                return;
+            }
+            FinishBody();
+        }
+
         // 接收并解析HTTP请求
         void RecvHttpRequest(Buffer *buf)
         {
@@ -208,7 +361,6 @@ namespace my_muduo
             switch (_recv_statu)
             {
             case RECV_HTTP_LINE:
-                RecvHttpLine(buf);
             case RECV_HTTP_HEAD:
                 RecvHttpHead(buf);
             case RECV_HTTP_BODY:
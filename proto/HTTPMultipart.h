@@ -0,0 +1,389 @@
+#pragma once
+
+#include "HTTPRequest.h"
+#include <strings.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+namespace my_muduo
+{
+#define MULTIPART_BOUNDARY_MAX 70   // RFC 2046 规定分隔符最长70个字符
+#define MULTIPART_HEAD_MAX (8 << 10) // 单个部分头部的最大长度，超过视为格式错误
+
+    typedef enum
+    {
+        MULTIPART_PREAMBLE, // 第一个分隔符之前的内容，丢弃
+        MULTIPART_BOUNDARY, // 刚匹配到分隔符，判断后面是CRLF（下一个部分）还是--（结束）
+        MULTIPART_HEAD,     // 部分的头部
+        MULTIPART_BODY,     // 部分的正文
+        MULTIPART_DONE,     // 遇到结束分隔符，之后的内容丢弃
+        MULTIPART_ERROR
+    } MultipartStatu;
+
+    // multipart中一个部分的头部信息
+    struct MultipartPart
+    {
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::string name;         // Content-Disposition中的name
+        std::string filename;     // Content-Disposition中的filename，普通表单字段为空
+        std::string content_type; // 没有Content-Type时按RFC 7578默认为text/plain
+
+        bool IsFile() const { return filename.empty() == false; }
+        std::string GetHeader(const char *key) const
+        {
+            for (auto &h : headers)
+            {
+                if (strcasecmp(h.first.c_str(), key) == 0)
+                    return h.second;
+            }
+            return "";
+        }
+    };
+
+    /* multipart/form-data 流式解析器：正文到来多少解析多少，不保存整个正文，也不保存已经解析完的部分。
+     * 每个部分的头部解析完后调用部分回调，回调返回这个部分的正文接收器（HTTPBodySink::File写入文件，
+     * 或者回调接收器），为空时丢弃这个部分的正文。
+     * 分隔符用Horspool算法查找，一次跳过最多一个分隔符的长度；两次输入之间只保留可能是分隔符前缀的几个字节，
+     * 其余正文数据直接从输入缓冲区交给接收器，不经过额外的拷贝。
+     * 通常在正文开始处理函数中用 HTTPMultipart::Create 创建，再把 Sink() 设置为请求的正文接收器。 */
+    class HTTPMultipart : public std::enable_shared_from_this<HTTPMultipart>
+    {
+    public:
+        using PartCallBack = std::function<std::shared_ptr<HTTPBodySink>(const MultipartPart &)>;
+
+    private:
+        std::string _delim;         // "\r\n--" + boundary
+        size_t _skip[256];          // Horspool跳转表
+        MultipartStatu _statu;
+        std::string _tail;          // 上次没有处理完的数据：可能是分隔符前缀的正文结尾，或者不完整的头部行
+        size_t _head_len;           // 当前部分头部已经处理的长度
+        MultipartPart _part;        // 当前部分
+        std::shared_ptr<HTTPBodySink> _sink; // 当前部分的正文接收器
+        PartCallBack _callback;
+        size_t _parts;              // 已经开始的部分个数
+
+    private:
+        // 在data中查找分隔符，返回偏移，没有找到返回npos
+        size_t Search(const char *data, size_t len) const
+        {
+            size_t m = _delim.size();
+            const unsigned char *p = (const unsigned char *)data;
+            unsigned char last = _delim[m - 1];
+            for (size_t i = 0; i + m <= len; i += _skip[p[i + m - 1]])
+            {
+                if (p[i + m - 1] == last && memcmp(p + i, _delim.data(), m - 1) == 0)
+                    return i;
+            }
+            return std::string::npos;
+        }
+        // 结尾可能是分隔符前缀的长度，这部分要留到下次输入时再判断
+        size_t PartialDelim(const char *data, size_t len) const
+        {
+            size_t start = len >= _delim.size() ? len - _delim.size() + 1 : 0;
+            for (size_t i = start; i < len; i++)
+            {
+                if (data[i] == '\r' && memcmp(data + i, _delim.data(), len - i) == 0)
+                    return len - i;
+            }
+            return 0;
+        }
+
+        bool Error(const char *reason)
+        {
+            LOGE("multipart: %s", reason);
+            _statu = MULTIPART_ERROR;
+            _sink.reset();
+            return false;
+        }
+        bool Emit(const char *data, size_t len)
+        {
+            if (len == 0 || _statu != MULTIPART_BODY || _sink == nullptr)
+                return true;
+            if (_sink->Write(data, len) == false)
+                return Error("part sink write failed");
+            return true;
+        }
+
+        // 去掉首尾空白
+        static std::string Trim(const char *begin, const char *end)
+        {
+            while (begin < end && (*begin == ' ' || *begin == '\t'))
+                begin++;
+            while (end > begin && (end[-1] == ' ' || end[-1] == '\t'))
+                end--;
+            return std::string(begin, end);
+        }
+        // 解析 form-data; name="a"; filename="b.txt" 这样的参数
+        static void DispositionParams(const std::string &value, MultipartPart *part)
+        {
+            std::string filename_ext;
+            size_t pos = value.find(';');
+            while (pos != std::string::npos)
+            {
+                size_t eq = value.find('=', pos + 1);
+                if (eq == std::string::npos)
+                    break;
+                std::string key = Trim(value.data() + pos + 1, value.data() + eq);
+                std::string val;
+                size_t i = eq + 1;
+                while (i < value.size() && (value[i] == ' ' || value[i] == '\t'))
+                    i++;
+                if (i < value.size() && value[i] == '"')
+                {
+                    for (i++; i < value.size() && value[i] != '"'; i++)
+                    {
+                        if (value[i] == '\\' && i + 1 < value.size())
+                            i++;
+                        val.push_back(value[i]);
+                    }
+                    pos = value.find(';', i);
+                }
+                else
+                {
+                    pos = value.find(';', i);
+                    val = Trim(value.data() + i, value.data() + (pos == std::string::npos ? value.size() : pos));
+                }
+                if (strcasecmp(key.c_str(), "name") == 0)
+                    part->name = val;
+                else if (strcasecmp(key.c_str(), "filename") == 0)
+                    part->filename = val;
+                else if (strcasecmp(key.c_str(), "filename*") == 0)
+                    filename_ext = val;
+            }
+            // RFC 5987：filename*=UTF-8''%E4%B8%AD.txt，优先于filename
+            size_t quote = filename_ext.find("''");
+            if (quote != std::string::npos)
+                part->filename = Util::UrlDecode(filename_ext.substr(quote + 2), false);
+        }
+
+        // 处理一行部分头部，空行表示头部结束
+        bool HeadLine(const char *line, size_t len)
+        {
+            if (len == 0)
+            {
+                std::string disposition = _part.GetHeader("Content-Disposition");
+                DispositionParams(disposition, &_part);
+                _part.content_type = _part.GetHeader("Content-Type");
+                if (_part.content_type.empty())
+                    _part.content_type = "text/plain";
+                _parts++;
+                _statu = MULTIPART_BODY;
+                _sink = _callback ? _callback(_part) : nullptr;
+                return true;
+            }
+            const char *colon = (const char *)memchr(line, ':', len);
+            if (colon == nullptr)
+                return Error("bad part header");
+            _part.headers.emplace_back(Trim(line, colon), Trim(colon + 1, line + len));
+            return true;
+        }
+
+        // 当前部分结束
+        bool EndPart()
+        {
+            std::shared_ptr<HTTPBodySink> sink = std::move(_sink);
+            if (_statu == MULTIPART_BODY && sink && sink->Finish() == false)
+                return Error("part sink finish failed");
+            return true;
+        }
+
+        // 尽可能多地处理数据，返回处理掉的长度，剩下的需要更多数据才能判断
+        size_t Consume(const char *data, size_t len)
+        {
+            size_t pos = 0;
+            while (pos < len)
+            {
+                switch (_statu)
+                {
+                case MULTIPART_PREAMBLE:
+                case MULTIPART_BODY:
+                {
+                    size_t found = Search(data + pos, len - pos);
+                    if (found == std::string::npos)
+                    {
+                        size_t keep = PartialDelim(data + pos, len - pos);
+                        if (Emit(data + pos, len - pos - keep) == false)
+                            return pos;
+                        return len - keep;
+                    }
+                    if (Emit(data + pos, found) == false || EndPart() == false)
+                        return pos;
+                    pos += found + _delim.size();
+                    _statu = MULTIPART_BOUNDARY;
+                    break;
+                }
+                case MULTIPART_BOUNDARY:
+                    // 分隔符后面允许有空白，然后是CRLF或者结束标记--
+                    if (data[pos] == ' ' || data[pos] == '\t')
+                    {
+                        pos++;
+                        break;
+                    }
+                    if (len - pos < 2)
+                        return pos;
+                    if (data[pos] == '-' && data[pos + 1] == '-')
+                        _statu = MULTIPART_DONE;
+                    else if (data[pos] == '\r' && data[pos + 1] == '\n')
+                    {
+                        _statu = MULTIPART_HEAD;
+                        _part = MultipartPart();
+                        _head_len = 0;
+                    }
+                    else
+                    {
+                        Error("bad boundary line");
+                        return pos;
+                    }
+                    pos += 2;
+                    break;
+                case MULTIPART_HEAD:
+                {
+                    const char *end = (const char *)memmem(data + pos, len - pos, "\r\n", 2);
+                    size_t line_len = end ? end - (data + pos) : len - pos;
+                    if (_head_len + line_len > MULTIPART_HEAD_MAX)
+                    {
+                        Error("part header too long");
+                        return pos;
+                    }
+                    if (end == nullptr)
+                        return pos;
+                    _head_len += line_len + 2;
+                    if (HeadLine(data + pos, line_len) == false)
+                        return pos;
+                    pos += line_len + 2;
+                    break;
+                }
+                case MULTIPART_DONE:
+                    return len; // 结束分隔符之后的内容直接丢弃
+                case MULTIPART_ERROR:
+                    return pos;
+                }
+            }
+            return pos;
+        }
+
+    public:
+        /**
+         * @brief 创建解析器
+         * @param boundary[in]   Content-Type中的boundary参数
+         * @param callback[in]   每个部分的头部解析完后调用，返回这个部分的正文接收器，返回空时丢弃正文
+         */
+        HTTPMultipart(const std::string &boundary, const PartCallBack &callback)
+            : _delim("\r\n--" + boundary), _statu(MULTIPART_PREAMBLE), _tail("\r\n"), _head_len(0), _callback(callback), _parts(0)
+        {
+            // _tail预先放一个CRLF：第一个分隔符前面可能没有CRLF，这样所有分隔符都可以统一查找
+            size_t m = _delim.size();
+            for (size_t i = 0; i < 256; i++)
+                _skip[i] = m;
+            for (size_t i = 0; i + 1 < m; i++)
+                _skip[(unsigned char)_delim[i]] = m - 1 - i;
+        }
+        HTTPMultipart(const HTTPMultipart &) = delete;
+        HTTPMultipart &operator=(const HTTPMultipart &) = delete;
+
+        /**
+         * @brief 从Content-Type中取出boundary参数
+         * @param content_type[in]   Content-Type头部的值
+         * @param boundary[out]      boundary参数
+         * @return 不是multipart或者没有合法的boundary时返回false
+         */
+        static bool Boundary(const std::string &content_type, std::string *boundary)
+        {
+            if (strncasecmp(content_type.c_str(), "multipart/", 10) != 0)
+                return false;
+            const char *p = strcasestr(content_type.c_str(), "boundary=");
+            if (p == nullptr)
+                return false;
+            p += 9;
+            if (*p == '"')
+            {
+                const char *end = strchr(p + 1, '"');
+                if (end == nullptr)
+                    return false;
+                boundary->assign(p + 1, end);
+            }
+            else
+                boundary->assign(p, strcspn(p, "; \t"));
+            return boundary->empty() == false && boundary->size() <= MULTIPART_BOUNDARY_MAX;
+        }
+
+        /**
+         * @brief 按请求的Content-Type创建解析器
+         * @param req[in]        请求，在正文开始处理函数中调用
+         * @param callback[in]   部分回调
+         * @return 请求不是multipart或者没有boundary时返回空
+         */
+        static std::shared_ptr<HTTPMultipart> Create(const HTTPRequest &req, const PartCallBack &callback)
+        {
+            std::string boundary;
+            if (Boundary(req.GetHeader("Content-Type"), &boundary) == false)
+                return nullptr;
+            return std::make_shared<HTTPMultipart>(boundary, callback);
+        }
+
+        /**
+         * @brief 输入一段正文，可以在任意位置切分
+         * @param data[in]       数据，只在调用期间使用
+         * @param len[in]        数据长度
+         * @return 格式错误或者部分接收器失败时返回false
+         */
+        bool Feed(const char *data, size_t len)
+        {
+            // 先把新数据补到上次剩下的数据后面，直到剩下的数据处理完，每次补的量有限，拷贝量与正文大小无关
+            while (len > 0 && _tail.empty() == false)
+            {
+                size_t old = _tail.size();
+                size_t add = std::min(len, std::max<size_t>(_delim.size(), 256));
+                _tail.append(data, add);
+                size_t used = Consume(_tail.data(), _tail.size());
+                if (_statu == MULTIPART_ERROR)
+                    return false;
+                if (used >= old)
+                {
+                    // 剩下的数据处理完了，新数据中没有处理的部分直接从输入中处理
+                    data += used - old;
+                    len -= used - old;
+                    _tail.clear();
+                }
+                else
+                {
+                    _tail.erase(0, used);
+                    data += add;
+                    len -= add;
+                }
+            }
+            if (len > 0)
+            {
+                size_t used = Consume(data, len);
+                if (_statu == MULTIPART_ERROR)
+                    return false;
+                _tail.assign(data + used, len - used);
+            }
+            return true;
+        }
+
+        // 正文结束，没有遇到结束分隔符时返回false
+        bool Finish()
+        {
+            if (_statu != MULTIPART_DONE)
+                return Error("unexpected end of body");
+            return true;
+        }
+
+        // 生成请求正文接收器，接收到的正文交给这个解析器
+        std::shared_ptr<HTTPBodySink> Sink()
+        {
+            std::shared_ptr<HTTPMultipart> self = shared_from_this();
+            return std::make_shared<HTTPBodySink>(
+                [self](const char *data, size_t len) { return self->Feed(data, len); },
+                [self]() { return self->Finish(); });
+        }
+
+        MultipartStatu Statu() const { return _statu; }
+        bool Done() const { return _statu == MULTIPART_DONE; }
+        size_t PartCount() const { return _parts; }
+    };
+}
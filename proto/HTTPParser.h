@@ -0,0 +1,354 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace my_muduo
+{
+#define MAX_LINE 8192           // 请求行和单个头部行的最大长度
+#define MAX_HEAD_SIZE (64 << 10) // 请求行加全部头部的最大长度
+#define MAX_HEADERS 64          // 头部字段的最大个数
+
+    // 报文中的一段数据，偏移相对于报文的起始位置（解析开始时Buffer的读位置）
+    struct HTTPSlice
+    {
+        uint32_t off;
+        uint32_t len;
+    };
+
+    struct HTTPHeaderSlice
+    {
+        HTTPSlice name;
+        HTTPSlice value;
+    };
+
+    typedef enum
+    {
+        PARSE_AGAIN, // 数据不足，等待新数据后继续
+        PARSE_DONE,  // 请求行和头部解析完毕
+        PARSE_ERROR  // 格式错误或超出限制，错误码见 ErrorStatu()
+    } HttpParseResult;
+
+    /* 增量式HTTP/1.x请求头解析器：
+     * 直接在缓冲区的字节上逐字节推进状态机，不拷贝、不分配内存，结果以偏移量的形式保存；
+     * 数据可以在任意字节处截断，再次调用时从上次停下的位置继续。
+     * 解析完成之前调用者不能移动缓冲区的读位置（缓冲区扩容搬移数据不影响偏移量）。 */
+    class HTTPParser
+    {
+    private:
+        typedef enum
+        {
+            S_METHOD,
+            S_TARGET,
+            S_VERSION,
+            S_LINE_LF,
+            S_HEADER_START,
+            S_HEADER_NAME,
+            S_HEADER_OWS,
+            S_HEADER_VALUE,
+            S_HEADER_LF,
+            S_HEAD_END_LF,
+            S_DONE,
+            S_ERROR
+        } State;
+
+        State _state;
+        uint32_t _pos;        // 已经解析过的字节数
+        uint32_t _line_start; // 当前行的起始位置
+        int _error_statu;     // 出错时应答的状态码
+        HTTPSlice _method;
+        HTTPSlice _target;    // 路径加查询字符串
+        HTTPSlice _path;
+        HTTPSlice _query;
+        HTTPSlice _version;
+        uint32_t _value_end;  // 当前头部值去掉末尾空白后的结束位置
+        int64_t _content_length;
+        size_t _header_count;
+        HTTPHeaderSlice _headers[MAX_HEADERS];
+
+    private:
+        // RFC 7230 token 字符
+        static bool IsToken(unsigned char c)
+        {
+            // 按位保存的字符表：数字、字母和 !#$%&'*+-.^_`|~
+            static const uint32_t table[8] = {0x00000000, 0x03ff6cfa, 0xc7fffffe, 0x57ffffff, 0, 0, 0, 0};
+            return table[c >> 5] & (1u << (c & 31));
+        }
+        // 请求目标中不允许出现控制字符和空白
+        static bool IsTargetChar(unsigned char c) { return c > 0x20 && c != 0x7f; }
+        // 头部值中允许可见字符、空白和obs-text
+        static bool IsValueChar(unsigned char c) { return c >= 0x20 ? c != 0x7f : c == '\t'; }
+
+        HttpParseResult Fail(int statu)
+        {
+            _state = S_ERROR;
+            _error_statu = statu;
+            return PARSE_ERROR;
+        }
+
+        static bool EqualNoCase(const char *data, HTTPSlice s, const char *str)
+        {
+            size_t len = strlen(str);
+            if (s.len != len)
+                return false;
+            for (size_t i = 0; i < len; i++)
+            {
+                char c = data[s.off + i];
+                if (c >= 'A' && c <= 'Z')
+                    c += 'a' - 'A';
+                if (c != str[i])
+                    return false;
+            }
+            return true;
+        }
+
+        // 版本只接受 HTTP/x.y 格式，x.y 不是 1.0 或 1.1 时返回505
+        bool CheckVersion(const char *data)
+        {
+            const char *v = data + _version.off;
+            if (_version.len != 8 || memcmp(v, "HTTP/", 5) != 0 || v[6] != '.' ||
+                v[5] < '0' || v[5] > '9' || v[7] < '0' || v[7] > '9')
+            {
+                Fail(400);
+                return false;
+            }
+            if (v[5] != '1' || (v[7] != '0' && v[7] != '1'))
+            {
+                Fail(505);
+                return false;
+            }
+            return true;
+        }
+
+        // 一个头部字段解析完成，Content-Length在这里校验
+        bool FinishHeader(const char *data)
+        {
+            HTTPHeaderSlice &h = _headers[_header_count++];
+            h.value.len = _value_end - h.value.off;
+            if (EqualNoCase(data, h.name, "content-length"))
+            {
+                if (h.value.len == 0 || h.value.len > 18)
+                {
+                    Fail(400);
+                    return false;
+                }
+                int64_t len = 0;
+                for (uint32_t i = 0; i < h.value.len; i++)
+                {
+                    char c = data[h.value.off + i];
+                    if (c < '0' || c > '9')
+                    {
+                        Fail(400);
+                        return false;
+                    }
+                    len = len * 10 + (c - '0');
+                }
+                // 多个Content-Length的值不一致时无法确定正文边界
+                if (_content_length >= 0 && _content_length != len)
+                {
+                    Fail(400);
+                    return false;
+                }
+                _content_length = len;
+            }
+            return true;
+        }
+
+    public:
+        HTTPParser() { Reset(); }
+
+        /**
+         * @brief 重置解析器，开始解析下一个请求
+         * @param 空
+         * @return 空
+         */
+        void Reset()
+        {
+            _state = S_METHOD;
+            _pos = 0;
+            _line_start = 0;
+            _error_statu = 0;
+            _method = _target = _path = _query = _version = HTTPSlice{0, 0};
+            _value_end = 0;
+            _content_length = -1;
+            _header_count = 0;
+        }
+
+        /**
+         * @brief 解析请求行和头部
+         * @param data[in]   报文起始位置，每次调用都必须从同一个报文的开头传入
+         * @param len[in]    当前可用的数据长度
+         * @return PARSE_AGAIN 数据不足; PARSE_DONE 解析完成，HeadLength()为头部长度; PARSE_ERROR 出错
+         */
+        HttpParseResult Execute(const char *data, size_t len)
+        {
+            if (_state == S_DONE)
+                return PARSE_DONE;
+            if (_state == S_ERROR)
+                return PARSE_ERROR;
+            if (len > MAX_HEAD_SIZE)
+                len = MAX_HEAD_SIZE + 1;
+            for (; _pos < len; _pos++)
+            {
+                unsigned char c = data[_pos];
+                switch (_state)
+                {
+                case S_METHOD:
+                    if ((c == '\r' || c == '\n') && _pos == _method.off)
+                    {
+                        // 忽略请求行之前的空行（有些客户端会在上一个请求的正文后多发一个CRLF）
+                        _method.off = _pos + 1;
+                        _line_start = _pos + 1;
+                    }
+                    else if (c == ' ' && _pos > _method.off)
+                    {
+                        _method.len = _pos - _method.off;
+                        _target.off = _pos + 1;
+                        _path.off = _pos + 1;
+                        _state = S_TARGET;
+                    }
+                    else if (IsToken(c) == false)
+                        return Fail(400);
+                    break;
+                case S_TARGET:
+                    // 连续的普通字符一次扫描完，减少状态分发
+                    for (size_t limit = std::min(len, (size_t)_line_start + MAX_LINE); _pos + 1 < limit; _pos++)
+                    {
+                        c = data[_pos];
+                        if (IsTargetChar(c) == false || c == '?')
+                            break;
+                    }
+                    c = data[_pos];
+                    if (c == ' ')
+                    {
+                        _target.len = _pos - _target.off;
+                        if (_target.len == 0)
+                            return Fail(400);
+                        if (_query.off == 0)
+                            _path.len = _pos - _path.off;
+                        else
+                            _query.len = _pos - _query.off;
+                        _version.off = _pos + 1;
+                        _state = S_VERSION;
+                    }
+                    else if (c == '?' && _query.off == 0)
+                    {
+                        _path.len = _pos - _path.off;
+                        _query.off = _pos + 1;
+                    }
+                    else if (IsTargetChar(c) == false)
+                        return Fail(400);
+                    break;
+                case S_VERSION:
+                    if (c == '\r' || c == '\n')
+                    {
+                        _version.len = _pos - _version.off;
+                        if (CheckVersion(data) == false)
+                            return PARSE_ERROR;
+                        _state = c == '\r' ? S_LINE_LF : S_HEADER_START;
+                        _line_start = _pos + 1;
+                    }
+                    else if (_pos - _version.off >= 8)
+                        return Fail(400);
+                    break;
+                case S_LINE_LF:
+                case S_HEADER_LF:
+                    if (c != '\n')
+                        return Fail(400);
+                    _state = S_HEADER_START;
+                    _line_start = _pos + 1;
+                    break;
+                case S_HEADER_START:
+                    if (c == '\r')
+                        _state = S_HEAD_END_LF;
+                    else if (c == '\n')
+                    {
+                        _pos++;
+                        _state = S_DONE;
+                        return PARSE_DONE;
+                    }
+                    else if (_header_count >= MAX_HEADERS)
+                        return Fail(431);
+                    else if (IsToken(c))
+                    {
+                        _headers[_header_count].name.off = _pos;
+                        _state = S_HEADER_NAME;
+                    }
+                    else // 行首的空白是已经废弃的折行写法，直接拒绝
+                        return Fail(400);
+                    break;
+                case S_HEADER_NAME:
+                    if (c == ':')
+                    {
+                        _headers[_header_count].name.len = _pos - _headers[_header_count].name.off;
+                        _state = S_HEADER_OWS;
+                    }
+                    else if (IsToken(c) == false)
+                        return Fail(400);
+                    break;
+                case S_HEADER_OWS:
+                    if (c == ' ' || c == '\t')
+                        break;
+                    _headers[_header_count].value.off = _pos;
+                    _value_end = _pos;
+                    _state = S_HEADER_VALUE;
+                    // fallthrough
+                case S_HEADER_VALUE:
+                    for (size_t limit = std::min(len, (size_t)_line_start + MAX_LINE); _pos + 1 < limit; _pos++)
+                    {
+                        c = data[_pos];
+                        if (c <= 0x20 || c == 0x7f)
+                            break;
+                        _value_end = _pos + 1;
+                    }
+                    c = data[_pos];
+                    if (c == '\r' || c == '\n')
+                    {
+                        if (FinishHeader(data) == false)
+                            return PARSE_ERROR;
+                        _state = c == '\r' ? S_HEADER_LF : S_HEADER_START;
+                        _line_start = _pos + 1;
+                    }
+                    else if (IsValueChar(c) == false)
+                        return Fail(400);
+                    else if (c != ' ' && c != '\t')
+                        _value_end = _pos + 1;
+                    break;
+                case S_HEAD_END_LF:
+                    if (c != '\n')
+                        return Fail(400);
+                    _pos++;
+                    _state = S_DONE;
+                    return PARSE_DONE;
+                default:
+                    return PARSE_ERROR;
+                }
+                // 单行过长：请求行返回414，头部行返回431
+                if (_pos + 1 - _line_start > MAX_LINE)
+                    return Fail(_state <= S_VERSION ? 414 : 431);
+            }
+            if (_pos > MAX_HEAD_SIZE)
+                return Fail(431);
+            return PARSE_AGAIN;
+        }
+
+        bool Done() const { return _state == S_DONE; }
+        // 请求行是否已经解析完成
+        bool LineDone() const { return _state > S_LINE_LF && _state != S_ERROR; }
+        int ErrorStatu() const { return _error_statu; }
+        // 请求行加头部（含结尾空行）的长度
+        size_t HeadLength() const { return _pos; }
+
+        HTTPSlice Method() const { return _method; }
+        HTTPSlice Target() const { return _target; }
+        HTTPSlice Path() const { return _path; }
+        HTTPSlice Query() const { return _query; }
+        HTTPSlice Version() const { return _version; }
+        // 没有Content-Length头部时返回-1
+        int64_t ContentLength() const { return _content_length; }
+        size_t HeaderCount() const { return _header_count; }
+        const HTTPHeaderSlice &Header(size_t i) const { return _headers[i]; }
+    };
+}
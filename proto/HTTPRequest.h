@@ -1,25 +1,177 @@
 #pragma once
 
 #include "TCPServer.h"
+#include "HTTPParser.h"
+#include "HTTPBodySink.h"
+#include "Util.h"
 #include <regex>
+#include <cctype>
 
 namespace my_muduo
 {
+    typedef enum
+    {
+        HTTP_GET,
+        HTTP_HEAD,
+        HTTP_POST,
+        HTTP_PUT,
+        HTTP_DELETE,
+        HTTP_OPTIONS,
+        HTTP_PATCH,
+        HTTP_METHOD_COUNT // 方法个数，同时表示不认识的方法
+    } HttpMethod;
+
+    typedef enum
+    {
+        HTTP_1_0,
+        HTTP_1_1
+    } HttpVersion;
+
+    // 常用头部字段，解析时直接记录位置，查找时不需要遍历
+    typedef enum
+    {
+        HEADER_HOST,
+        HEADER_CONNECTION,
+        HEADER_CONTENT_LENGTH,
+        HEADER_CONTENT_TYPE,
+        HEADER_TRANSFER_ENCODING,
+        HEADER_EXPECT,
+        HEADER_ACCEPT_ENCODING,
+        HEADER_RANGE,
+        HEADER_IF_RANGE,
+        HEADER_IF_NONE_MATCH,
+        HEADER_IF_MODIFIED_SINCE,
+        HEADER_COUNT // 常用头部的个数，同时表示其它头部
+    } HttpHeaderId;
+
+    // 指向请求数据中的一段字符，不拥有数据
+    struct HTTPView
+    {
+        const char *data;
+        size_t size;
+
+        bool Empty() const { return size == 0; }
+        std::string ToString() const { return std::string(data, size); }
+        bool operator==(const char *str) const { return strlen(str) == size && memcmp(data, str, size) == 0; }
+        bool EqualNoCase(const char *str, size_t len) const
+        {
+            if (len != size)
+                return false;
+            for (size_t i = 0; i < size; i++)
+            {
+                if (tolower((unsigned char)data[i]) != tolower((unsigned char)str[i]))
+                    return false;
+            }
+            return true;
+        }
+        bool EqualNoCase(const char *str) const { return EqualNoCase(str, strlen(str)); }
+    };
+
+    // 路由匹配到的路径参数，值是 _path 中的一段
+    struct HTTPPathParam
+    {
+        const std::string *name; // 指向路由表中的参数名
+        size_t off;
+        size_t len;
+    };
+
+    /* 请求行和头部不再拷贝成字符串，只记录在报文中的位置（HTTPSlice），
+     * 报文仍然保存在连接的输入缓冲区中，请求处理完后才从缓冲区中移除；
+     * 需要在处理函数返回之后继续使用请求时，先调用 Own() 把报文拷贝到请求自己的存储中。
+     * 各容器在ReSet时只清空不释放，同一连接上的后续请求不再分配内存。 */
     class HTTPRequest
     {
     public:
-        std::string _method;                                   // 请求方法
-        std::string _path;                                     // 资源路径
-        std::string _body;                                     // 协议版本
-        std::string _version;                                  // 请求正文
-        std::smatch _matches;                                  // 资源路径的正则提取数据
-        std::unordered_map<std::string, std::string> _headers; // 头部字段
-        std::unordered_map<std::string, std::string> _params;  // 查询字符串
-    public:
+        HttpMethod _method;                      // 请求方法
+        HttpVersion _version;                    // 协议版本
+        std::string _path;                       // 资源路径（已经URL解码）
+        std::string _body;                       // 请求正文
+        std::smatch _matches;                    // 资源路径的正则提取数据
+        std::vector<HTTPPathParam> _path_params; // 路由匹配到的路径参数
+
+    private:
+        const char *_base;                     // 报文起始位置，所有切片都相对于这里
+        size_t _head_len;                      // 请求行加头部的长度
+        std::string _own;                      // Own()之后报文保存在这里
+        std::vector<HTTPHeaderSlice> _headers; // 头部字段
+        std::vector<HTTPHeaderSlice> _params;  // 查询字符串，保存的是未解码的原始数据
+        int _known[HEADER_COUNT];              // 常用头部在_headers中的下标，-1表示没有
+        size_t _content_length;
+        bool _keep_alive;
+        std::shared_ptr<HTTPBodySink> _sink;   // 正文接收器，为空时正文保存到_body
+
+    private:
+        HTTPView View(HTTPSlice s) const { return HTTPView{_base + s.off, s.len}; }
+
+        // Connection 头部是逗号分隔的列表，逐项比较
+        static bool HasToken(HTTPView list, const char *token)
+        {
+            size_t len = strlen(token);
+            const char *p = list.data, *end = list.data + list.size;
+            while (p < end)
+            {
+                while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+                    p++;
+                const char *item = p;
+                while (p < end && *p != ',')
+                    p++;
+                const char *item_end = p;
+                while (item_end > item && (item_end[-1] == ' ' || item_end[-1] == '\t'))
+                    item_end--;
+                if (HTTPView{item, (size_t)(item_end - item)}.EqualNoCase(token, len))
+                    return true;
+            }
+            return false;
+        }
+
+        // 查询字符串的格式 key=val&key=val.....，只记录位置，获取时再解码
+        bool ParseQuery(HTTPSlice query)
+        {
+            uint32_t pos = query.off, end = query.off + query.len;
+            while (pos < end)
+            {
+                const char *amp = (const char *)memchr(_base + pos, '&', end - pos);
+                uint32_t item_end = amp ? amp - _base : end;
+                if (item_end > pos)
+                {
+                    const char *eq = (const char *)memchr(_base + pos, '=', item_end - pos);
+                    if (eq == nullptr)
+                        return false;
+                    uint32_t eq_pos = eq - _base;
+                    _params.push_back(HTTPHeaderSlice{HTTPSlice{pos, eq_pos - pos}, HTTPSlice{eq_pos + 1, item_end - eq_pos - 1}});
+                }
+                pos = item_end + 1;
+            }
+            return true;
+        }
+
+        int FindHeader(const char *key, size_t len) const
+        {
+            HttpHeaderId id = HeaderId(key, len);
+            if (id != HEADER_COUNT)
+                return _known[id];
+            for (size_t i = 0; i < _headers.size(); i++)
+            {
+                if (View(_headers[i].name).EqualNoCase(key, len))
+                    return i;
+            }
+            return -1;
+        }
 
-        HTTPRequest()
-            :_version("HTTP/1.1")
-        {}
+        int FindParam(const std::string &key) const
+        {
+            std::string name;
+            for (size_t i = 0; i < _params.size(); i++)
+            {
+                Util::UrlDecode(_base + _params[i].name.off, _params[i].name.len, true, &name);
+                if (name == key)
+                    return i;
+            }
+            return -1;
+        }
+
+    public:
+        HTTPRequest() : _base(nullptr) { ReSet(); }
 
         /**
          * @brief 重置
@@ -28,64 +180,197 @@ namespace my_muduo
          */
         void ReSet()
         {
-            _method.clear();
+            _method = HTTP_GET;
+            _version = HTTP_1_1;
             _path.clear();
             _body.clear();
-            _version = "HTTP/1.1";
             std::smatch match;
             _matches.swap(match);
+            _path_params.clear();
+            _base = _own.data();
+            _head_len = 0;
+            _own.clear();
             _headers.clear();
             _params.clear();
+            for (int i = 0; i < HEADER_COUNT; i++)
+                _known[i] = -1;
+            _content_length = 0;
+            _keep_alive = true;
+            _sink.reset();
         }
 
         /**
-         * @brief 插入HTTP请求头字段
-         * @param key[in]    键
-         * @param val[in]    值
+         * @brief 根据解析器的结果设置请求行和头部
+         * @param base[in]       报文起始位置
+         * @param parser[in]     已经解析完成的解析器
+         * @return 查询字符串格式错误时返回false
+         */
+        bool SetHead(const char *base, const HTTPParser &parser)
+        {
+            _base = base;
+            _head_len = parser.HeadLength();
+            HTTPView method = View(parser.Method());
+            _method = MethodType(method.data, method.size);
+            _version = _base[parser.Version().off + 7] == '0' ? HTTP_1_0 : HTTP_1_1;
+            // 资源路径需要进行URL解码操作，但是不需要+转空格
+            HTTPSlice path = parser.Path();
+            Util::UrlDecode(_base + path.off, path.len, false, &_path);
+            for (size_t i = 0; i < parser.HeaderCount(); i++)
+            {
+                const HTTPHeaderSlice &h = parser.Header(i);
+                HttpHeaderId id = HeaderId(_base + h.name.off, h.name.len);
+                if (id != HEADER_COUNT && _known[id] < 0)
+                    _known[id] = _headers.size();
+                _headers.push_back(h);
+            }
+            _content_length = parser.ContentLength() > 0 ? parser.ContentLength() : 0;
+            // HTTP/1.1默认长连接，HTTP/1.0默认短连接
+            HTTPView conn = Header(HEADER_CONNECTION);
+            if (_version == HTTP_1_1)
+                _keep_alive = HasToken(conn, "close") == false;
+            else
+                _keep_alive = HasToken(conn, "keep-alive");
+            return ParseQuery(parser.Query());
+        }
+
+        /**
+         * @brief 把报文拷贝到请求自己的存储中，之后请求不再依赖输入缓冲区
+         * @param 空
+         * @return 空
+         */
+        void Own()
+        {
+            if (_base == _own.data())
+                return;
+            _own.assign(_base, _head_len);
+            _base = _own.data();
+        }
+
+        /**
+         * @brief 把请求移动到dst中（比如交给异步应答保存），之后这个对象被重置，可以接收下一个请求
+         *        报文先拷贝到请求自己的内存中，不再引用输入缓冲区；正则路由的匹配结果不会移动
+         * @param dst[out]       目标请求
          * @return 空
          */
-        void SetHeader(const std::string &key, const std::string &val)
+        void MoveTo(HTTPRequest *dst)
+        {
+            Own();
+            dst->_method = _method;
+            dst->_version = _version;
+            dst->_path.swap(_path);
+            dst->_body.swap(_body);
+            dst->_path_params.swap(_path_params);
+            dst->_head_len = _head_len;
+            dst->_own.swap(_own);
+            dst->_base = dst->_own.data(); // 短字符串交换时数据会被拷贝，重新指向
+            dst->_headers.swap(_headers);
+            dst->_params.swap(_params);
+            memcpy(dst->_known, _known, sizeof(_known));
+            dst->_content_length = _content_length;
+            dst->_keep_alive = _keep_alive;
+            dst->_sink.swap(_sink);
+            ReSet();
+        }
+
+        /**
+         * @brief 请求方法与字符串的转换
+         * @param method[in]     请求方法
+         * @return 方法名，不认识的方法返回空字符串 / HTTP_METHOD_COUNT
+         */
+        static const char *MethodName(HttpMethod method)
+        {
+            static const char *names[HTTP_METHOD_COUNT + 1] = {"GET", "HEAD", "POST", "PUT", "DELETE", "OPTIONS", "PATCH", ""};
+            return names[method];
+        }
+        static HttpMethod MethodType(const char *method, size_t len)
+        {
+            for (int m = 0; m < HTTP_METHOD_COUNT; m++)
+            {
+                if (HTTPView{method, len}.EqualNoCase(MethodName((HttpMethod)m)))
+                    return (HttpMethod)m;
+            }
+            return HTTP_METHOD_COUNT;
+        }
+        const char *MethodName() const { return MethodName(_method); }
+        const char *VersionName() const { return _version == HTTP_1_0 ? "HTTP/1.0" : "HTTP/1.1"; }
+
+        /**
+         * @brief 头部字段名对应的常用头部编号，不区分大小写
+         * @param name[in]   字段名
+         * @param len[in]    字段名长度
+         * @return 常用头部编号，其它头部返回 HEADER_COUNT
+         */
+        static HttpHeaderId HeaderId(const char *name, size_t len)
+        {
+            static const char *names[HEADER_COUNT] = {
+                "host", "connection", "content-length", "content-type", "transfer-encoding", "expect",
+                "accept-encoding", "range", "if-range", "if-none-match", "if-modified-since"};
+            for (int i = 0; i < HEADER_COUNT; i++)
+            {
+                // 先比较长度和首字母，绝大多数情况下不需要逐字比较
+                if (strlen(names[i]) == len && (name[0] | 0x20) == names[i][0] && HTTPView{name, len}.EqualNoCase(names[i], len))
+                    return (HttpHeaderId)i;
+            }
+            return HEADER_COUNT;
+        }
+
+        /**
+         * @brief 获取常用头部字段的值
+         * @param id[in]     常用头部编号
+         * @return 头部字段的值，不存在时为空
+         */
+        HTTPView Header(HttpHeaderId id) const
         {
-            _headers.insert({key, val});
+            if (_known[id] < 0)
+                return HTTPView{"", 0};
+            return View(_headers[_known[id]].value);
         }
 
+        // 按顺序遍历全部头部字段
+        size_t HeaderCount() const { return _headers.size(); }
+        HTTPView HeaderName(size_t i) const { return View(_headers[i].name); }
+        HTTPView HeaderValue(size_t i) const { return View(_headers[i].value); }
+
         /**
-         * @brief 判断是否存在指定HTTP请求头部字段
+         * @brief 判断是否存在指定HTTP请求头部字段，不区分大小写
          * @param key[in]        键
          * @return 判断结果
          */
         bool HasHeader(const std::string &key) const
         {
-            auto it = _headers.find(key);
-            if (it == _headers.end())
-                return false;
-
-            return true;
+            return FindHeader(key.c_str(), key.size()) >= 0;
         }
 
         /**
-         * @brief 获取HTTP请求头部字段的值
+         * @brief 获取HTTP请求头部字段的值，不区分大小写
          * @param key[in]        键
          * @return 头部字段的值
          */
+        HTTPView HeaderView(const std::string &key) const
+        {
+            int i = FindHeader(key.c_str(), key.size());
+            if (i < 0)
+                return HTTPView{"", 0};
+            return View(_headers[i].value);
+        }
         std::string GetHeader(const std::string &key) const
         {
-            auto it = _headers.find(key);
-            if (it == _headers.end())
-                return "";
-
-            return it->second;
+            return HeaderView(key).ToString();
         }
 
-        /**
-         * @brief 插入查询字符串
-         * @param key[in]    键
-         * @param val[in]    值
-         * @return 空
-         */
-        void SetParam(std::string &key, std::string &val)
+        // 按顺序遍历全部查询字符串，返回解码后的键和值
+        size_t ParamCount() const { return _params.size(); }
+        std::string ParamName(size_t i) const
+        {
+            std::string name;
+            Util::UrlDecode(_base + _params[i].name.off, _params[i].name.len, true, &name);
+            return name;
+        }
+        std::string ParamValue(size_t i) const
         {
-            _params.insert({key, val});
+            std::string value;
+            Util::UrlDecode(_base + _params[i].value.off, _params[i].value.len, true, &value);
+            return value;
         }
 
         /**
@@ -93,13 +378,9 @@ namespace my_muduo
          * @param key[in]    键
          * @return 判断结果
          */
-        bool HasParam(std::string &key) const
+        bool HasParam(const std::string &key) const
         {
-            auto it = _params.find(key);
-            if (it == _params.end())
-                return false;
-
-            return true;
+            return FindParam(key) >= 0;
         }
 
         /**
@@ -107,43 +388,50 @@ namespace my_muduo
          * @param key[in]    键
          * @return 查询字符串
          */
-        std::string GetParam(std::string &key) const 
+        std::string GetParam(const std::string &key) const
         {
-            auto it = _params.find(key);
-            if (it == _params.end())
+            int i = FindParam(key);
+            if (i < 0)
                 return "";
-
-            return it->second;
+            return ParamValue(i);
         }
 
         /**
-         * @brief 获取正文长度
-         * @param url[in]        源URL
-         * @param seconvert_space_to_plusq[in]    判断字符是否是 +
-         * @return 正文长度
+         * @brief 获取路由匹配到的路径参数
+         * @param name[in]   参数名，即路由中 :name 或 *name 的名称
+         * @return 参数值，不存在时返回空字符串
          */
-        size_t ContentLength() const 
+        std::string PathParam(const std::string &name) const
         {
-            bool ret = HasHeader("Content-Length");
-            if(ret == false)
-                return 0;
-            
-            std::string clen = GetHeader("Content-Length");
-            return std::stoi(clen);
+            for (auto &param : _path_params)
+            {
+                if (*param.name == name)
+                    return _path.substr(param.off, param.len);
+            }
+            return "";
         }
 
+        /**
+         * @brief 获取正文长度，解析头部时已经校验并转换
+         * @param 空
+         * @return 正文长度
+         */
+        size_t ContentLength() const { return _content_length; }
+
+        /**
+         * @brief 设置正文接收器，只能在正文开始处理函数中调用，之后的正文交给接收器，不再保存到_body
+         * @param sink[in]       正文接收器
+         * @return 空
+         */
+        void SetBodySink(const std::shared_ptr<HTTPBodySink> &sink) { _sink = sink; }
+        const std::shared_ptr<HTTPBodySink> &BodySink() const { return _sink; }
+
         /**
          * @brief 判断是否是短连接
          * @param 空
          * @return 判断结果
          */
-        bool Close() const
-        {
-            if(HasHeader("Connection") == true && GetHeader("Connection") == "keep-alive")
-                return false;
-            
-            return true;
-        }
+        bool Close() const { return _keep_alive == false; }
     };
 
 }
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "TCPServer.h"
+#include "HTTPRequest.h"
+#include "HTTPResponse.h"
+#include <atomic>
+
+namespace my_muduo
+{
+    /* 异步应答：异步处理函数（HTTPServer::GetAsync等接口添加）收到的对象，保存了请求和待填充的响应。
+     * 处理函数可以立即返回，把应答交给其他线程（比如访问后端服务），填充完响应后在任意线程调用Done，
+     * 应答被投递回连接所属的loop线程发送，loop线程在等待期间继续处理其他连接和同一连接上的后续请求。
+     * 同一连接上流水线请求的应答按请求的顺序发送，前面的应答没有完成时，后面已经完成的应答排队等待。 */
+    class HTTPResponder
+    {
+    private:
+        std::weak_ptr<Connection> _conn; // 发送应答的连接，连接关闭后失效，Done不再发送
+        HTTPRequest _request;
+        HTTPResponse _response;
+        std::atomic<bool> _done; // 响应已经填充完毕，loop线程看到之后才能读取响应
+        bool _async;             // 由异步处理函数生成，发送前服务器再做条件请求和压缩的处理
+        bool _close;             // 发送之后关闭连接（请求出错）
+
+    public:
+        HTTPResponder(const PtrConnection &conn, int statu, bool async)
+            : _conn(conn), _response(statu), _done(false), _async(async), _close(false) {}
+        HTTPResponder(const HTTPResponder &) = delete;
+        HTTPResponder &operator=(const HTTPResponder &) = delete;
+
+        // 请求，处理函数中可以在任意线程读取
+        const HTTPRequest &Request() const { return _request; }
+        // 待填充的响应，Done之前由处理函数（一次只在一个线程中）填充，Done之后不能再访问
+        HTTPResponse *Response() { return &_response; }
+
+        // 响应填充完毕，可以在任意线程调用，重复调用被忽略
+        void Done()
+        {
+            if (_done.exchange(true, std::memory_order_acq_rel))
+                return;
+            PtrConnection conn = _conn.lock();
+            if (conn)
+                conn->ProcessInput(); // 在连接所属的loop中按顺序发送已经完成的应答
+        }
+        // 连接已经关闭，之后的Done不会发送，处理函数可以放弃还没有开始的工作
+        bool Closed() const { return _conn.expired(); }
+
+        // 以下接口由服务器调用
+
+        HTTPRequest &MutableRequest() { return _request; }
+        bool Finished() const { return _done.load(std::memory_order_acquire); }
+        // 同步生成的应答直接标记完成，不需要通知loop
+        void Ready() { _done.store(true, std::memory_order_release); }
+        bool Async() const { return _async; }
+        void SetClose() { _close = true; }
+        bool Close() const { return _close; }
+    };
+    using PtrResponder = std::shared_ptr<HTTPResponder>;
+}
@@ -1,22 +1,63 @@
 #pragma once
 
 #include "TCPServer.h"
+#include "FileCache.h"
+#include "HTTPStream.h"
+#include "Util.h"
 #include <regex>
 
 namespace my_muduo
 {
+    // 文件中要发送的一段数据
+    struct HTTPFileRange
+    {
+        off_t offset;
+        size_t length;
+        std::string head; // 多段响应时这一段之前的分隔行和头部
+    };
+
     class HTTPResponse
     {
+    private:
+        // 头部字段名不区分大小写
+        static bool EqualNoCase(const std::string &a, const std::string &b)
+        {
+            if (a.size() != b.size())
+                return false;
+            for (size_t i = 0; i < a.size(); i++)
+            {
+                if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+                    return false;
+            }
+            return true;
+        }
+        const std::pair<std::string, std::string> *Find(const std::string &key) const
+        {
+            for (auto &head : _headers)
+            {
+                if (EqualNoCase(head.first, key))
+                    return &head;
+            }
+            return nullptr;
+        }
+
     public:
         int _statu;
         bool _redirect_flag;
         std::string _body;
         std::string _redirect_url;
-        std::unordered_map<std::string, std::string> _headers;
+        std::vector<std::pair<std::string, std::string>> _headers; // 头部字段很少，顺序存放，按设置的顺序发送
+        std::shared_ptr<const FileEntry> _file;                     // 命中静态文件缓存时，正文和类型、长度头部都从这里发送，不使用_body
+        std::shared_ptr<const OpenFile> _sendfile;                  // 没有缓存内容的静态文件，正文用sendfile从描述符直接发送
+        std::vector<HTTPFileRange> _ranges;                         // _sendfile中要发送的范围，为空时发送整个文件
+        std::string _ranges_tail;                                   // 多段响应最后的结束分隔行
+        std::string _etag;                                          // 实体标签，为空时表示没有设置
+        time_t _last_modified;                                      // 最后修改时间，为-1时表示没有设置
+        std::shared_ptr<HTTPStream> _stream;                        // 流式发送的正文，不为空时不使用_body
 
     public:
-        HTTPResponse() : _redirect_flag(false), _statu(200) {}
-        HTTPResponse(int statu) : _redirect_flag(false), _statu(statu) {}
+        HTTPResponse() : _redirect_flag(false), _statu(200), _last_modified(-1) {}
+        HTTPResponse(int statu) : _redirect_flag(false), _statu(statu), _last_modified(-1) {}
 
         void ReSet()
         {
@@ -25,17 +66,28 @@ namespace my_muduo
             _body.clear();
             _redirect_url.clear();
             _headers.clear();
+            _file.reset();
+            _sendfile.reset();
+            _ranges.clear();
+            _ranges_tail.clear();
+            _etag.clear();
+            _last_modified = -1;
+            _stream.reset();
         }
 
         /**
-         * @brief 插入HTTP响应头部字段
+         * @brief 设置HTTP响应头部字段，字段已经存在时替换原来的值
          * @param key[in]    键
          * @param val[in]    值
          * @return 空
          */
         void SetHeader(const std::string &key, const std::string &val)
         {
-            _headers.insert({key, val});
+            auto head = const_cast<std::pair<std::string, std::string> *>(Find(key));
+            if (head != nullptr)
+                head->second = val;
+            else
+                _headers.emplace_back(key, val);
         }
 
         /**
@@ -43,13 +95,9 @@ namespace my_muduo
          * @param key[in]        键
          * @return 判断结果
          */
-        bool HasHeader(const std::string &key)
+        bool HasHeader(const std::string &key) const
         {
-            auto it = _headers.find(key);
-            if (it == _headers.end())
-                return false;
-
-            return true;
+            return Find(key) != nullptr;
         }
 
         /**
@@ -57,13 +105,13 @@ namespace my_muduo
          * @param key[in]        键
          * @return 头部字段的值
          */
-        std::string GetHeader(const std::string &key)
+        std::string GetHeader(const std::string &key) const
         {
-            auto it = _headers.find(key);
-            if (it == _headers.end())
+            auto head = Find(key);
+            if (head == nullptr)
                 return "";
 
-            return it->second;
+            return head->second;
         }
 
         /**
@@ -74,7 +122,49 @@ namespace my_muduo
         void SetContent(const std::string &body, const std::string &type = "text/html")
         {
             _body = body;
-            SetHeader("Content-type", type);
+            SetHeader("Content-Type", type);
+        }
+        // 正文较大时移动进来，避免拷贝
+        void SetContent(std::string &&body, const std::string &type = "text/html")
+        {
+            _body = std::move(body);
+            SetHeader("Content-Type", type);
+        }
+
+        /**
+         * @brief 改为流式发送正文，写入器可以保存下来，在处理函数返回之后继续写入，最后调用End结束
+         * @param type[in]       正文类型
+         * @return 流式响应写入器
+         */
+        std::shared_ptr<HTTPStream> Stream(const std::string &type = "application/octet-stream")
+        {
+            if (_stream == nullptr)
+                _stream = std::make_shared<HTTPStream>();
+            SetHeader("Content-Type", type);
+            return _stream;
+        }
+
+        /**
+         * @brief 设置实体标签，请求带有匹配的If-None-Match时自动应答304
+         * @param etag[in]       标签内容，不包含双引号
+         * @param weak[in]       是否是弱验证器
+         * @return 空
+         */
+        void SetETag(const std::string &etag, bool weak = false)
+        {
+            _etag = (weak ? "W/\"" : "\"") + etag + "\"";
+            SetHeader("ETag", _etag);
+        }
+
+        /**
+         * @brief 设置最后修改时间，请求带有不早于它的If-Modified-Since时自动应答304
+         * @param t[in]          最后修改时间
+         * @return 空
+         */
+        void SetLastModified(time_t t)
+        {
+            _last_modified = t;
+            SetHeader("Last-Modified", Util::HttpDate(t));
         }
 
         /**
@@ -0,0 +1,263 @@
+#pragma once
+
+#include "HTTPRequest.h"
+#include "HTTPResponse.h"
+#include <functional>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cassert>
+
+namespace my_muduo
+{
+    typedef enum
+    {
+        PARAM_STRING, // :name 匹配一个非空的路径段
+        PARAM_INT     // :name<int> 只匹配整数
+    } PathParamType;
+
+    /* 压缩前缀树路由：
+     * 静态路径按公共前缀压缩存放，一次查找只与请求路径比较一遍；
+     * :name 匹配一个路径段，*name 匹配剩余的全部路径，优先级 静态 > 参数 > 通配，匹配失败时回溯；
+     * 每个节点按请求方法存放处理函数，处理函数的类型由模板参数决定。 */
+    template <class H>
+    class BasicHTTPRouter
+    {
+    public:
+        using Handler = H;
+
+    private:
+        struct Node
+        {
+            std::string prefix;                          // 静态节点的路径片段
+            std::vector<std::unique_ptr<Node>> children; // 静态子节点，首字符各不相同
+            std::unique_ptr<Node> param;                 // 参数子节点
+            std::unique_ptr<Node> wildcard;              // 通配子节点
+            std::string name;                            // 参数或通配的名称
+            PathParamType type;
+            Handler handlers[HTTP_METHOD_COUNT];
+            bool has_handler;
+
+            Node() : type(PARAM_STRING), has_handler(false) {}
+
+            Node *Child(char c)
+            {
+                for (auto &child : children)
+                {
+                    if (child->prefix[0] == c)
+                        return child.get();
+                }
+                return nullptr;
+            }
+        };
+
+        Node _root;
+
+    private:
+        // 插入静态路径片段，必要时拆分已有节点的公共前缀
+        static Node *InsertStatic(Node *node, std::string seg)
+        {
+            while (seg.empty() == false)
+            {
+                std::unique_ptr<Node> *slot = nullptr;
+                for (auto &child : node->children)
+                {
+                    if (child->prefix[0] == seg[0])
+                        slot = &child;
+                }
+                if (slot == nullptr)
+                {
+                    node->children.emplace_back(new Node());
+                    node->children.back()->prefix = seg;
+                    return node->children.back().get();
+                }
+                Node *child = slot->get();
+                size_t common = 0;
+                while (common < seg.size() && common < child->prefix.size() && seg[common] == child->prefix[common])
+                    common++;
+                if (common < child->prefix.size())
+                {
+                    // 拆分：公共前缀成为新的中间节点，原节点保留剩余部分
+                    std::unique_ptr<Node> mid(new Node());
+                    mid->prefix = child->prefix.substr(0, common);
+                    child->prefix.erase(0, common);
+                    mid->children.emplace_back(std::move(*slot));
+                    *slot = std::move(mid);
+                    child = slot->get();
+                }
+                seg.erase(0, common);
+                node = child;
+            }
+            return node;
+        }
+
+        static bool MatchParam(const char *seg, size_t len, PathParamType type)
+        {
+            if (len == 0)
+                return false;
+            if (type == PARAM_STRING)
+                return true;
+            size_t i = seg[0] == '-' ? 1 : 0;
+            if (i == len)
+                return false;
+            for (; i < len; i++)
+            {
+                if (seg[i] < '0' || seg[i] > '9')
+                    return false;
+            }
+            return true;
+        }
+
+        // 深度优先查找，参数按匹配顺序追加到params中，回溯时撤销
+        static Node *Match(Node *node, const std::string &path, size_t pos, std::vector<HTTPPathParam> *params)
+        {
+            if (pos == path.size())
+            {
+                if (node->has_handler)
+                    return node;
+            }
+            else
+            {
+                Node *child = node->Child(path[pos]);
+                if (child != nullptr && path.compare(pos, child->prefix.size(), child->prefix) == 0)
+                {
+                    Node *ret = Match(child, path, pos + child->prefix.size(), params);
+                    if (ret != nullptr)
+                        return ret;
+                }
+                if (node->param)
+                {
+                    size_t end = path.find('/', pos);
+                    if (end == std::string::npos)
+                        end = path.size();
+                    if (MatchParam(path.c_str() + pos, end - pos, node->param->type))
+                    {
+                        params->push_back(HTTPPathParam{&node->param->name, pos, end - pos});
+                        Node *ret = Match(node->param.get(), path, end, params);
+                        if (ret != nullptr)
+                            return ret;
+                        params->pop_back();
+                    }
+                }
+            }
+            if (node->wildcard && node->wildcard->has_handler)
+            {
+                params->push_back(HTTPPathParam{&node->wildcard->name, pos, path.size() - pos});
+                return node->wildcard.get();
+            }
+            return nullptr;
+        }
+
+    public:
+        /**
+         * @brief 添加路由
+         * @param method[in]     请求方法
+         * @param pattern[in]    路径模式，如 /user/:id<int>，参数和通配符的写法见类说明
+         * @param handler[in]    处理函数
+         * @return 空
+         */
+        void Add(HttpMethod method, const std::string &pattern, const Handler &handler)
+        {
+            assert(pattern.empty() == false && pattern[0] == '/');
+            Node *node = &_root;
+            size_t pos = 0;
+            while (pos < pattern.size())
+            {
+                if (pattern[pos] == ':' && pattern[pos - 1] == '/')
+                {
+                    size_t end = pattern.find('/', pos);
+                    if (end == std::string::npos)
+                        end = pattern.size();
+                    std::string name = pattern.substr(pos + 1, end - pos - 1);
+                    PathParamType type = PARAM_STRING;
+                    size_t angle = name.find('<');
+                    if (angle != std::string::npos)
+                    {
+                        assert(name.substr(angle) == "<int>");
+                        type = PARAM_INT;
+                        name.erase(angle);
+                    }
+                    assert(name.empty() == false);
+                    if (!node->param)
+                    {
+                        node->param.reset(new Node());
+                        node->param->name = name;
+                        node->param->type = type;
+                    }
+                    // 同一位置的参数只能有一种写法
+                    assert(node->param->name == name && node->param->type == type);
+                    node = node->param.get();
+                    pos = end;
+                }
+                else if (pattern[pos] == '*' && pattern[pos - 1] == '/')
+                {
+                    std::string name = pattern.substr(pos + 1);
+                    assert(name.empty() == false && name.find('/') == std::string::npos);
+                    if (!node->wildcard)
+                    {
+                        node->wildcard.reset(new Node());
+                        node->wildcard->name = name;
+                    }
+                    assert(node->wildcard->name == name);
+                    node = node->wildcard.get();
+                    pos = pattern.size();
+                }
+                else
+                {
+                    // 静态片段一直到下一个参数或者通配符
+                    size_t end = pos;
+                    while (end < pattern.size() && !((pattern[end] == ':' || pattern[end] == '*') && pattern[end - 1] == '/'))
+                        end++;
+                    node = InsertStatic(node, pattern.substr(pos, end - pos));
+                    pos = end;
+                }
+            }
+            node->handlers[method] = handler;
+            node->has_handler = true;
+        }
+
+        /**
+         * @brief 查找路由
+         * @param method[in]     请求方法，HEAD没有单独的处理函数时使用GET的
+         * @param req[in/out]    请求，匹配到的路径参数保存在 _path_params 中
+         * @param statu[out]     200 找到; 404 路径不存在; 405 路径存在但不支持该方法
+         * @param allow[out]     405时路径支持的方法列表，可以为空
+         * @return 处理函数，没有找到时返回nullptr
+         */
+        const Handler *Find(HttpMethod method, HTTPRequest &req, int *statu, std::string *allow = nullptr)
+        {
+            req._path_params.clear();
+            Node *node = Match(&_root, req._path, 0, &req._path_params);
+            if (node == nullptr)
+            {
+                *statu = 404;
+                return nullptr;
+            }
+            if (!node->handlers[method] && method == HTTP_HEAD)
+                method = HTTP_GET;
+            if (!node->handlers[method])
+            {
+                if (allow != nullptr)
+                {
+                    allow->clear();
+                    for (int m = 0; m < HTTP_METHOD_COUNT; m++)
+                    {
+                        if (!node->handlers[m])
+                            continue;
+                        if (allow->empty() == false)
+                            allow->append(", ");
+                        allow->append(HTTPRequest::MethodName((HttpMethod)m));
+                    }
+                }
+                req._path_params.clear();
+                *statu = 405;
+                return nullptr;
+            }
+            *statu = 200;
+            return &node->handlers[method];
+        }
+    };
+
+    // 请求处理函数的路由表
+    typedef BasicHTTPRouter<std::function<void(const HTTPRequest &, HTTPResponse *)>> HTTPRouter;
+}
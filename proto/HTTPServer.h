@@ -2,22 +2,42 @@
 #include "HTTPContext.h"
 #include "HTTPRequest.h"
 #include "HTTPResponse.h"
+#include "HTTPRouter.h"
+#include "HTTPCompress.h"
+#include "HTTPMultipart.h"
 
 namespace my_muduo
 {
 #define DEFALT_TIMEOUT 10
+#define HTTP_BODY_INLINE_MAX 16384 // 不超过这个长度的正文拷贝到头部之后一起发送，更大的正文移交给连接，不拷贝
+#define HTTP_MAX_RANGES 16          // Range头部中最多的范围个数，超过时忽略Range发送整个文件
+#define HTTP_COMPRESS_MIN 1024      // 动态响应启用压缩后，正文不小于这个长度才压缩
+#define ACCEPT_DEFLATE (1u << ENCODING_COUNT) // Accept-Encoding中的deflate，只用于动态响应的压缩
+#define HTTP_SPLICE_MIN (256 << 10) // 写入文件的正文剩余长度不小于这个值时从套接字直接splice到文件
+#define HTTP_PIPELINE_MAX 16        // 一个连接上最多排队的应答个数，达到后暂停处理后续请求，等前面的应答发送出去
+
+    static_assert(sizeof(HTTPContext) <= CONTEXT_INLINE_SIZE, "HTTPContext放不进连接上下文的内联存储，需要调大CONTEXT_INLINE_SIZE");
+    static_assert(std::is_nothrow_move_constructible<HTTPContext>::value, "HTTPContext的移动构造需要是noexcept，否则连接上下文会在堆上分配");
 
     class HTTPServer
     {
     private:
-        using Handler = std::function<void(const HTTPRequest &, HTTPResponse *)>;
+        using Handler = HTTPRouter::Handler;
         using Handlers = std::vector<std::pair<std::regex, Handler>>;
-        Handlers _get_route;
-        Handlers _post_route;
-        Handlers _put_route;
-        Handlers _delete_route;
+        using BodyHandler = std::function<void(HTTPRequest &, HTTPResponse *)>;
+        using AsyncHandler = std::function<void(const PtrResponder &)>;
+        HTTPRouter _router;                        // 前缀树路由表
+        BasicHTTPRouter<BodyHandler> _body_router; // 正文开始处理函数的路由表，头部接收完毕、正文到来之前查找
+        BasicHTTPRouter<AsyncHandler> _async_router; // 异步处理函数的路由表，先于其他路由查找
+        Handlers _regex_route[HTTP_METHOD_COUNT]; // 正则路由表，前缀树中没有找到时才会查找
         TCPServer _server;
         std::string _basedir; // 静态资源根目录
+        OpenFileCache _open_cache; // 打开文件缓存，保存热点文件的描述符和属性，各个loop线程共用
+        FileCache _file_cache;     // 静态文件内容缓存，各个loop线程共用
+        size_t _max_body;          // 请求正文的长度上限，为0时不限制
+        bool _compress;                           // 是否压缩动态响应的正文
+        size_t _compress_min;                     // 压缩的最小正文长度
+        std::vector<std::string> _compress_types; // 可以压缩的正文类型，以/*结尾时匹配整个大类
 
     private:
         void ErrorHandler(const HTTPRequest &req, HTTPResponse *rsp)
@@ -39,8 +59,9 @@ namespace my_muduo
             // 2. 将页面数据，当作响应正文，放入rsp中
             rsp->SetContent(body, "text/html");
         }
-        // 将HTTPResponse中的要求按照http协议组织发送
-        void WriteResponse(const PtrConnection &conn, const HTTPRequest &req, HTTPResponse &rsp)
+        // 将HTTPResponse中的要求按照http协议组织到out中，一次处理的多个应答合并在out中，处理结束后由SendBatch一起发送
+        // 大块正文、文件和流式正文不经过out，先把out中已有的数据交给连接排队，保证应答的顺序
+        void WriteResponse(const PtrConnection &conn, const HTTPRequest &req, HTTPResponse &rsp, Buffer *out)
         {
             // 1. 先完善头部字段
             if (req.Close() == true)
@@ -48,32 +69,106 @@ namespace my_muduo
             else
                 rsp.SetHeader("Connection", "keep-alive");
 
-            if (rsp._body.empty() == false && rsp.HasHeader("Content-Length") == false)
+            // 完整的静态文件的类型和长度头部已经预先组织好了，范围响应的头部在FileHandler中已经设置
+            bool ranged = rsp._ranges.empty() == false;
+            bool file_body = rsp._file || rsp._sendfile;
+            // 1xx、204和304应答没有正文
+            bool no_body = rsp._statu < 200 || rsp._statu == 204 || rsp._statu == 304;
+            // 流式正文的长度未知，HTTP/1.1分块传输，HTTP/1.0发送完关闭连接；处理函数设置了长度时直接发送
+            bool streamed = rsp._stream != nullptr, chunked = false;
+            if (streamed && no_body == false && rsp.HasHeader("Content-Length") == false)
+            {
+                if (req._version == HTTP_1_0)
+                    rsp.SetHeader("Connection", "close");
+                else
+                    chunked = true;
+            }
+            if (chunked)
+                rsp.SetHeader("Transfer-Encoding", "chunked");
+            if (file_body == false && streamed == false && no_body == false && rsp.HasHeader("Content-Length") == false)
                 rsp.SetHeader("Content-Length", std::to_string(rsp._body.size()));
 
-            if (rsp._body.empty() == false && rsp.HasHeader("Content-Type") == false)
+            if (file_body == false && rsp._body.empty() == false && rsp.HasHeader("Content-Type") == false)
                 rsp.SetHeader("Content-Type", "application/octet-stream");
 
             if (rsp._redirect_flag == true)
                 rsp.SetHeader("Location", rsp._redirect_url);
-            // 2. 将rsp中的要素，按照HTTP协议格式进行组织
-            std::stringstream rsp_str;
-            rsp_str << req._version << " " << std::to_string(rsp._statu) << " " << Util::StatuDesc(rsp._statu) << "\r\n";
+            // 2. 状态行查表得到，状态行和头部直接写入发送用的缓冲区
+            out->WriteStringAndPush(Util::StatuLine(rsp._statu, req._version == HTTP_1_0 ? 0 : 1));
+            if (rsp.HasHeader("Date") == false)
+            {
+                out->WriteAndPush("Date: ", 6);
+                out->WriteAndPush(Util::HttpDate(), 29);
+                out->WriteAndPush("\r\n", 2);
+            }
             for (auto &head : rsp._headers)
-                rsp_str << head.first << ": " << head.second << "\r\n";
-            rsp_str << "\r\n";
-            rsp_str << rsp._body;
-            // 3. 发送数据
-            conn->Send(rsp_str.str().c_str(), rsp_str.str().size());
+            {
+                out->WriteStringAndPush(head.first);
+                out->WriteAndPush(": ", 2);
+                out->WriteStringAndPush(head.second);
+                out->WriteAndPush("\r\n", 2);
+            }
+            if (rsp._file)
+                out->WriteStringAndPush(rsp._file->headers);
+            else if (rsp._sendfile && ranged == false)
+                out->WriteStringAndPush(rsp._sendfile->headers);
+            out->WriteAndPush("\r\n", 2);
+            // 3. 流式正文先发送头部，之后的数据由写入器发送，结束后继续处理后续请求
+            if (streamed)
+            {
+                conn->Append(out);
+                rsp._stream->Start(conn, chunked, rsp.Close(), req._method == HTTP_HEAD || no_body,
+                                   std::bind(&HTTPServer::OnStreamEnd, this, std::weak_ptr<Connection>(conn)));
+                return;
+            }
+            // HEAD请求和没有正文的应答只发送头部
+            if (req._method == HTTP_HEAD || no_body)
+                return;
+            // 4. 小的正文和头部放在一起发送，大的正文直接移交给连接，不再拷贝，文件数据用sendfile发送
+            if (ranged)
+            {
+                conn->Append(out);
+                for (auto &range : rsp._ranges)
+                {
+                    if (range.head.empty() == false)
+                        conn->Send(std::move(range.head));
+                    conn->SendFile(rsp._sendfile, rsp._sendfile->fd, range.offset, range.length);
+                }
+                if (rsp._ranges_tail.empty() == false)
+                    conn->Send(std::move(rsp._ranges_tail));
+                return;
+            }
+            if (rsp._file)
+            {
+                const std::shared_ptr<const std::string> &body = rsp._file->body;
+                if (body->size() <= HTTP_BODY_INLINE_MAX)
+                {
+                    out->WriteStringAndPush(*body);
+                    return;
+                }
+                conn->Append(out);
+                conn->Send(body);
+                return;
+            }
+            if (rsp._sendfile)
+            {
+                conn->Append(out);
+                conn->SendFile(rsp._sendfile, rsp._sendfile->fd, 0, rsp._sendfile->st.st_size);
+                return;
+            }
+            if (rsp._body.size() <= HTTP_BODY_INLINE_MAX)
+            {
+                out->WriteStringAndPush(rsp._body);
+                return;
+            }
+            conn->Append(out);
+            conn->Send(std::move(rsp._body));
         }
 
-        // 功能性请求分类处理
-        void Dispatcher(HTTPRequest &req, HTTPResponse *rsp, Handlers &handlers)
+        // 正则路由：在对应请求方法的路由表中，使用正则表达式对请求的资源路径进行匹配，匹配成功就使用对应函数进行处理
+        //  /number/(\d+)    /numbers/12345
+        bool RegexDispatcher(HTTPRequest &req, HTTPResponse *rsp, Handlers &handlers)
         {
-            // 在对应请求方法的路由表中，查找是否含有对应资源的处理函数，有则调用，没有则返回404
-            // 思想：路由表存储是存储的键值对 —— 正则表达式 & 处理函数
-            // 使用正则表达式，对请求的资源路径进行正则匹配，匹配成功就使用对应函数进行处理
-            //  /number/(\d+)    /numbers/12345
             for (auto &handler : handlers)
             {
                 const std::regex &re = handler.first;
@@ -82,28 +177,282 @@ namespace my_muduo
                 if (ret == false)
                     continue;
 
-                return functor(req, rsp); // 传入请求信息和空的rsp，执行处理函数
+                functor(req, rsp); // 传入请求信息和空的rsp，执行处理函数
+                return true;
             }
-            rsp->_statu = 404;
+            return false;
+        }
+
+        // 功能性请求分类处理：先查前缀树，没有找到再依次尝试正则路由，都没有找到返回404，路径存在但方法不支持返回405
+        void Dispatcher(HTTPRequest &req, HTTPResponse *rsp, HttpMethod method)
+        {
+            int statu = 404;
+            std::string allow;
+            const Handler *handler = _router.Find(method, req, &statu, &allow);
+            if (handler != nullptr)
+                return (*handler)(req, rsp);
+            if (RegexDispatcher(req, rsp, _regex_route[method]))
+                return;
+            if (method == HTTP_HEAD && RegexDispatcher(req, rsp, _regex_route[HTTP_GET]))
+                return;
+            rsp->_statu = statu;
+            if (statu == 405)
+                rsp->SetHeader("Allow", allow);
         }
 
         // 静态资源的请求处理
-        void FileHandler(const HTTPRequest &req, HTTPResponse *rsp)
+        // 读取一个非负整数，最多18位
+        static bool ReadNumber(const char **pos, const char *end, off_t *num)
         {
-            std::string req_path = _basedir + req._path;
-            if (req._path.back() == '/')
-                req_path += "index.html";
+            const char *p = *pos;
+            off_t n = 0;
+            while (p < end && *p >= '0' && *p <= '9' && p - *pos < 18)
+                n = n * 10 + (*p++ - '0');
+            if (p == *pos || (p < end && *p >= '0' && *p <= '9'))
+                return false;
+            *pos = p;
+            *num = n;
+            return true;
+        }
+
+        /**
+         * @brief 解析Range头部，格式如 bytes=0-99,200-,-50
+         * @param value[in]      Range头部的值
+         * @param size[in]       文件大小
+         * @param ranges[out]    可以满足的范围，每个范围为[first, last]
+         * @return 200 格式错误或者不支持，忽略Range; 206 按范围发送; 416 没有可以满足的范围
+         */
+        static int ParseRange(HTTPView value, off_t size, std::vector<std::pair<off_t, off_t>> *ranges)
+        {
+            const char *p = value.data, *end = value.data + value.size;
+            if (value.size < 6 || strncasecmp(p, "bytes=", 6) != 0)
+                return 200;
+            p += 6;
+            size_t count = 0;
+            while (p < end)
+            {
+                // 跳过空白和空的列表元素
+                if (*p == ' ' || *p == '\t' || *p == ',')
+                {
+                    p++;
+                    continue;
+                }
+                if (++count > HTTP_MAX_RANGES)
+                    return 200;
+                off_t first = -1, last = -1;
+                if (*p != '-' && ReadNumber(&p, end, &first) == false)
+                    return 200;
+                if (p == end || *p != '-')
+                    return 200;
+                p++;
+                if (p < end && *p >= '0' && *p <= '9' && ReadNumber(&p, end, &last) == false)
+                    return 200;
+                while (p < end && (*p == ' ' || *p == '\t'))
+                    p++;
+                if (p < end && *p != ',')
+                    return 200;
+                if (first < 0)
+                {
+                    // -n 表示最后n个字节
+                    if (last < 0)
+                        return 200;
+                    if (last == 0 || size == 0)
+                        continue;
+                    first = last >= size ? 0 : size - last;
+                    last = size - 1;
+                }
+                else
+                {
+                    if (last >= 0 && last < first)
+                        return 200;
+                    if (first >= size)
+                        continue;
+                    if (last < 0 || last >= size)
+                        last = size - 1;
+                }
+                ranges->push_back(std::make_pair(first, last));
+            }
+            if (count == 0)
+                return 200;
+            return ranges->empty() ? 416 : 206;
+        }
+
+        /**
+         * @brief 解析Accept-Encoding，得到客户端可以接受的编码
+         * @param value[in]      Accept-Encoding头部的值，如 gzip, deflate, br;q=0.9
+         * @return 按位表示的编码集合，第i位对应FileEncoding中的第i种编码，deflate对应ACCEPT_DEFLATE
+         */
+        static unsigned AcceptEncodings(HTTPView value)
+        {
+            unsigned accept = 0, reject = 0;
+            bool any = false;
+            const char *p = value.data, *end = value.data + value.size;
+            while (p < end)
+            {
+                while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+                    p++;
+                const char *name = p;
+                while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t')
+                    p++;
+                size_t len = p - name;
+                // q=0 表示不接受，其他的参数和权重不区分优先级，由服务器按br、gzip的顺序选择
+                bool zero = false;
+                while (p < end && *p != ',')
+                {
+                    if ((*p == 'q' || *p == 'Q') && p + 1 < end && p[1] == '=')
+                    {
+                        const char *q = p + 2;
+                        zero = q < end && *q == '0';
+                        for (q++; zero && q < end && *q != ',' && *q != ';' && *q != ' '; q++)
+                            zero = *q == '.' || *q == '0';
+                    }
+                    p++;
+                }
+                unsigned bit = 0;
+                if (len == 2 && strncasecmp(name, "br", 2) == 0)
+                    bit = 1u << ENCODING_BR;
+                else if ((len == 4 && strncasecmp(name, "gzip", 4) == 0) || (len == 6 && strncasecmp(name, "x-gzip", 6) == 0))
+                    bit = 1u << ENCODING_GZIP;
+                else if (len == 7 && strncasecmp(name, "deflate", 7) == 0)
+                    bit = ACCEPT_DEFLATE;
+                else if (len == 1 && *name == '*')
+                    any = zero == false;
+                if (zero)
+                    reject |= bit;
+                else
+                    accept |= bit;
+            }
+            if (any)
+                accept |= (ACCEPT_DEFLATE << 1) - 1;
+            return accept & ~reject;
+        }
 
-            bool ret = Util::ReadFile(req_path, &rsp->_body);
-            if (ret == false)
+        // 客户端支持时选择预压缩文件，按br、gzip的顺序优先
+        static const std::shared_ptr<const OpenFile> &Negotiate(const HTTPRequest &req, const std::shared_ptr<const OpenFile> &file)
+        {
+            HTTPView value = req.Header(HEADER_ACCEPT_ENCODING);
+            if (value.Empty())
+                return file;
+            unsigned accept = AcceptEncodings(value);
+            for (int i = 0; i < ENCODING_COUNT; i++)
+            {
+                if (file->encoded[i] && (accept & (1u << i)))
+                    return file->encoded[i];
+            }
+            return file;
+        }
+
+        // If-Range中的验证器（实体标签或者修改时间）与文件当前的版本一致时才按范围发送，否则发送整个文件
+        static bool IfRangeMatch(const HTTPRequest &req, const OpenFile &file)
+        {
+            HTTPView cond = req.Header(HEADER_IF_RANGE);
+            if (cond.Empty())
+                return true;
+            if (cond.data[0] == '"')
+                return cond == file.etag.c_str();
+            return cond == file.last_modified.c_str();
+        }
+
+        // 条件请求：If-None-Match优先，没有时再看If-Modified-Since，资源没有变化时返回true，应答304
+        static bool NotModified(const HTTPRequest &req, const std::string &etag, time_t last_modified)
+        {
+            if (req._method != HTTP_GET && req._method != HTTP_HEAD)
+                return false;
+            HTTPView inm = req.Header(HEADER_IF_NONE_MATCH);
+            if (inm.Empty() == false)
+                return etag.empty() == false && Util::ETagMatch(inm.data, inm.size, etag);
+            HTTPView ims = req.Header(HEADER_IF_MODIFIED_SINCE);
+            time_t since;
+            if (ims.Empty() == false && last_modified >= 0 && Util::ParseHttpDate(ims.data, ims.size, &since))
+                return last_modified <= since;
+            return false;
+        }
+
+        // 组织范围响应，一个范围时直接发送，多个范围时使用 multipart/byteranges
+        static void RangeHandler(HTTPResponse *rsp, const std::shared_ptr<const OpenFile> &file,
+                                 const std::vector<std::pair<off_t, off_t>> &ranges)
+        {
+            std::string size = std::to_string(file->st.st_size);
+            rsp->_statu = 206;
+            rsp->_sendfile = file;
+            rsp->SetHeader("ETag", file->etag);
+            rsp->SetHeader("Last-Modified", file->last_modified);
+            if (file->vary)
+                rsp->SetHeader("Vary", "Accept-Encoding");
+            if (ranges.size() == 1)
+            {
+                off_t first = ranges[0].first, last = ranges[0].second;
+                rsp->SetHeader("Content-Type", file->mime);
+                if (file->encoding.empty() == false)
+                    rsp->SetHeader("Content-Encoding", file->encoding);
+                rsp->SetHeader("Content-Range", "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + size);
+                rsp->SetHeader("Content-Length", std::to_string(last - first + 1));
+                rsp->_ranges.push_back(HTTPFileRange{first, (size_t)(last - first + 1), ""});
                 return;
+            }
+            static std::atomic<uint64_t> seq(time(nullptr));
+            char boundary[32];
+            snprintf(boundary, sizeof(boundary), "%020llu", (unsigned long long)seq++);
+            size_t length = 0;
+            for (auto &range : ranges)
+            {
+                std::string head = "\r\n--";
+                head += boundary;
+                head += "\r\nContent-Type: " + file->mime;
+                head += "\r\nContent-Range: bytes " + std::to_string(range.first) + "-" + std::to_string(range.second) + "/" + size;
+                head += "\r\n\r\n";
+                size_t len = range.second - range.first + 1;
+                length += head.size() + len;
+                rsp->_ranges.push_back(HTTPFileRange{range.first, len, std::move(head)});
+            }
+            rsp->_ranges_tail = std::string("\r\n--") + boundary + "--\r\n";
+            length += rsp->_ranges_tail.size();
+            rsp->SetHeader("Content-Type", std::string("multipart/byteranges; boundary=") + boundary);
+            if (file->encoding.empty() == false)
+                rsp->SetHeader("Content-Encoding", file->encoding);
+            rsp->SetHeader("Content-Length", std::to_string(length));
+        }
 
-            std::string mime = Util::ExtMime(req_path);
-            rsp->SetHeader("Content-Type", mime);
+        void FileHandler(const HTTPRequest &req, HTTPResponse *rsp, const std::shared_ptr<const OpenFile> &origin)
+        {
+            // 0. 内容协商，有客户端支持的预压缩文件时发送预压缩文件，之后的处理都针对选中的文件
+            //    完整文件的响应头部已经预先组织好了，其他响应需要单独带上Vary
+            const std::shared_ptr<const OpenFile> &file = Negotiate(req, origin);
+            // 1. 条件请求，文件没有变化时只应答304
+            if (NotModified(req, file->etag, file->st.st_mtime))
+            {
+                rsp->_statu = 304; // Not Modified
+                rsp->SetHeader("ETag", file->etag);
+                rsp->SetHeader("Last-Modified", file->last_modified);
+                if (file->vary)
+                    rsp->SetHeader("Vary", "Accept-Encoding");
+                return;
+            }
+            // 2. 带Range头部的GET请求只发送请求的范围，数据都从描述符直接发送
+            HTTPView range = req.Header(HEADER_RANGE);
+            if (range.Empty() == false && req._method == HTTP_GET && IfRangeMatch(req, *file))
+            {
+                std::vector<std::pair<off_t, off_t>> ranges;
+                int statu = ParseRange(range, file->st.st_size, &ranges);
+                if (statu == 416)
+                {
+                    rsp->_statu = 416; // Range Not Satisfiable
+                    rsp->SetHeader("Content-Range", "bytes */" + std::to_string(file->st.st_size));
+                    if (file->vary)
+                        rsp->SetHeader("Vary", "Accept-Encoding");
+                    return;
+                }
+                if (statu == 206)
+                    return RangeHandler(rsp, file, ranges);
+            }
+            // 3. 小文件使用缓存的内容，大文件或者关闭了内容缓存时从描述符直接发送
+            rsp->_file = _file_cache.Lookup(*file);
+            if (rsp->_file == nullptr)
+                rsp->_sendfile = file;
             return;
         }
-
-        bool IsFileHandler(const HTTPRequest &req)
+        // 是静态资源请求时返回true，file为打开的文件
+        bool IsFileHandler(const HTTPRequest &req, std::shared_ptr<const OpenFile> *file)
         {
             // 1. 必须设置了静态资源根目录
             if (_basedir.empty())
@@ -111,7 +460,7 @@ namespace my_muduo
                 return false;
             }
             // 2. 请求方法，必须是GET / HEAD请求方法
-            if (req._method != "GET" && req._method != "HEAD")
+            if (req._method != HTTP_GET && req._method != HTTP_HEAD)
             {
                 return false;
             }
@@ -124,12 +473,16 @@ namespace my_muduo
             //    有一种请求比较特殊 -- 目录：/, /image/， 这种情况给后边默认追加一个 index.html
             // index.html    /image/a.png
             // 不要忘了前缀的相对根目录,也就是将请求路径转换为实际存在的路径  /image/a.png  ->   ./wwwroot/image/a.png
-            std::string req_path = _basedir + req._path; // 为了避免直接修改请求的资源路径，因此定义一个临时对象
+            std::string req_path;
+            req_path.reserve(_basedir.size() + req._path.size() + 10);
+            req_path += _basedir;
+            req_path += req._path;
             if (req._path.back() == '/')
             {
                 req_path += "index.html";
             }
-            if (Util::IsRegular(req_path) == false)
+            //    查打开文件缓存，未到校验时间时不需要访问文件系统
+            if (_open_cache.Lookup(req_path, file) == false)
             {
                 return false;
             }
@@ -137,58 +490,281 @@ namespace my_muduo
         }
 
         // 寻找处理请求方法
+        // 处理函数设置了验证器时，资源没有变化则应答304
+        void CheckNotModified(const HTTPRequest &req, HTTPResponse *rsp)
+        {
+            if (rsp->_statu == 200 && (rsp->_etag.empty() == false || rsp->_last_modified >= 0) &&
+                NotModified(req, rsp->_etag, rsp->_last_modified))
+            {
+                rsp->_statu = 304;
+                rsp->_body.clear();
+            }
+        }
+
         void Route(HTTPRequest &req, HTTPResponse *rsp) 
         {
             //1. 对请求进行分辨，是一个静态资源请求，还是一个功能性请求
             //   静态资源请求，则进行静态资源的处理
             //   功能性请求，则需要通过几个请求路由表来确定是否有处理函数
             //   既不是静态资源请求，也没有设置对应的功能性请求处理函数，就返回405
-            if (IsFileHandler(req) == true) {
+            std::shared_ptr<const OpenFile> file;
+            if (IsFileHandler(req, &file) == true) {
                 //是一个静态资源请求, 则进行静态资源请求的处理
-                return FileHandler(req, rsp);
+                return FileHandler(req, rsp, file);
             }
-            if (req._method == "GET" || req._method == "HEAD") {
-                return Dispatcher(req, rsp, _get_route);
-            }else if (req._method == "POST") {
-                return Dispatcher(req, rsp, _post_route);
-            }else if (req._method == "PUT") {
-                return Dispatcher(req, rsp, _put_route);
-            }else if (req._method == "DELETE") {
-                return Dispatcher(req, rsp, _delete_route);
+            if (req._method != HTTP_METHOD_COUNT) {
+                Dispatcher(req, rsp, req._method);
+                CheckNotModified(req, rsp);
+                return;
             }
             rsp->_statu = 405;// Method Not Allowed
             return;
         }
 
+        // 正文类型是否在可以压缩的类型列表中，比较时忽略 ; 之后的参数
+        bool CompressibleType(const std::string &type) const
+        {
+            size_t len = type.find(';');
+            if (len == std::string::npos)
+                len = type.size();
+            while (len > 0 && type[len - 1] == ' ')
+                len--;
+            for (auto &allow : _compress_types)
+            {
+                size_t cmp = allow.size();
+                if (cmp >= 2 && allow.compare(cmp - 2, 2, "/*") == 0)
+                    cmp--; // text/* 只比较 text/
+                else if (cmp != len)
+                    continue;
+                if (cmp <= len && strncasecmp(type.c_str(), allow.c_str(), cmp) == 0)
+                    return true;
+            }
+            return false;
+        }
+
+        // 动态响应的正文压缩：类型和长度满足条件时带上Vary，客户端支持时按gzip、deflate的顺序选择编码压缩
+        // 压缩器从当前loop线程的池中取用，用完重置后放回；流式正文长度未知，不看长度，边写边压缩
+        void CompressHandler(const HTTPRequest &req, HTTPResponse *rsp)
+        {
+            // 1. 静态文件、范围响应、已经编码或者自己设置了长度的正文不处理
+            if (rsp->_file || rsp->_sendfile || rsp->_ranges.empty() == false)
+                return;
+            if (rsp->_statu < 200 || rsp->_statu >= 300 || rsp->_statu == 204 || rsp->_statu == 206)
+                return;
+            bool streamed = rsp->_stream != nullptr;
+            if ((streamed == false && rsp->_body.size() < _compress_min) || rsp->HasHeader("Content-Encoding") ||
+                rsp->HasHeader("Content-Length"))
+                return;
+            if (CompressibleType(rsp->GetHeader("Content-Type")) == false)
+                return;
+            // 2. 响应随Accept-Encoding变化，不论这次是否压缩都需要告诉缓存
+            std::string vary = rsp->GetHeader("Vary");
+            rsp->SetHeader("Vary", vary.empty() ? "Accept-Encoding" : vary + ", Accept-Encoding");
+            HTTPView value = req.Header(HEADER_ACCEPT_ENCODING);
+            if (value.Empty())
+                return;
+            unsigned accept = AcceptEncodings(value);
+            CompressType type = COMPRESS_NONE;
+            if (accept & (1u << ENCODING_GZIP))
+                type = COMPRESS_GZIP;
+            else if (accept & ACCEPT_DEFLATE)
+                type = COMPRESS_DEFLATE;
+            if (type == COMPRESS_NONE)
+                return;
+            // 3. 压缩后没有变小时发送原来的正文
+            if (streamed)
+                rsp->_stream->Compress(type);
+            else
+            {
+                std::string body;
+                if (DeflaterPool::Compress(type, rsp->_body, &body) == false || body.size() >= rsp->_body.size())
+                    return;
+                rsp->_body.swap(body);
+            }
+            rsp->SetHeader("Content-Encoding", type == COMPRESS_GZIP ? "gzip" : "deflate");
+            // 4. 压缩后的内容与原来的字节不同，强验证器改为弱验证器
+            if (rsp->_etag.empty() == false && rsp->_etag[0] == '"')
+            {
+                rsp->_etag = "W/" + rsp->_etag;
+                rsp->SetHeader("ETag", rsp->_etag);
+            }
+        }
+
         // 设置
         void OnConnected(const PtrConnection &conn)
         {
-            conn->SetContext(HTTPContext());
+            conn->GetContext()->emplace<HTTPContext>(_max_body);
             // LOGI("NEW CONNECTION");
         }
 
-        // 缓冲区数据解析+处理
-        void OnMessage(const PtrConnection &conn, Buffer *buf)
+        // 连接关闭时丢弃正在流式发送的响应，释放生产者持有的资源
+        void OnClosed(const PtrConnection &conn)
         {
-            // LOGI("ReadAbleSize %d", buf->ReadAbleSize());
-            while (buf->ReadAbleSize() > 0)
+            if (conn->GetContext()->is<HTTPContext>() == false)
+                return;
+            conn->GetContext()->get<HTTPContext>()->AbortStream();
+            conn->GetContext()->get<HTTPContext>()->AbortQueue();
+        }
+
+        // 按请求的顺序发送排队的应答，遇到还没有完成的应答就停下，后面已经完成的继续排队
+        // 返回false表示开始了流式发送或者连接将要关闭，暂停处理后续请求
+        bool WriteQueued(const PtrConnection &conn, HTTPContext *context, Buffer *out)
+        {
+            while (context->Streaming() == false)
+            {
+                PtrResponder responder = context->Dequeue();
+                if (responder == nullptr)
+                    return true;
+                HTTPRequest &req = responder->MutableRequest();
+                HTTPResponse &rsp = *responder->Response();
+                // 异步处理函数在其他线程中填充响应，条件请求和压缩在发送之前处理
+                if (responder->Async())
+                {
+                    CheckNotModified(req, &rsp);
+                    if (_compress)
+                        CompressHandler(req, &rsp);
+                }
+                WriteResponse(conn, req, rsp, out);
+                if (rsp._stream && rsp._stream->Ended() == false)
+                {
+                    context->SetStream(rsp._stream);
+                    return false;
+                }
+                if (responder->Close() || rsp.Close())
+                {
+                    context->AbortQueue();
+                    SendBatch(conn, out);
+                    conn->ShutDown();
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * @brief 请求的应答需要排队：有异步处理函数，或者前面还有没有发送的应答
+         *        请求移动到应答对象中，缓冲区中的请求数据被移除，之后继续处理后续请求
+         * @param async[in]      异步处理函数，为空时同步处理（出错的请求rsp已经设置好错误码）
+         * @param rsp[in]        已经得到的响应状态
+         * @return 空
+         */
+        void QueueRequest(const PtrConnection &conn, HTTPContext *context, Buffer *buf, const AsyncHandler *async, HTTPResponse &rsp)
+        {
+            PtrResponder responder = std::make_shared<HTTPResponder>(conn, rsp._statu, async != nullptr);
+            if (rsp._statu >= 400)
+            {
+                // 出错的请求：应答排在前面的应答之后，发送后关闭连接，没有读取的数据直接丢弃
+                *responder->Response() = std::move(rsp);
+                responder->SetClose();
+                context->Enqueue(responder, buf);
+                buf->MoveReadOffset(buf->ReadAbleSize());
+                responder->Ready();
+                return;
+            }
+            context->Enqueue(responder, buf);
+            if (async)
+                return (*async)(responder);
+            Route(responder->MutableRequest(), responder->Response());
+            if (_compress)
+                CompressHandler(responder->Request(), responder->Response());
+            responder->Ready();
+        }
+
+        // 流式响应结束，继续处理暂停期间已经收到的后续请求
+        void OnStreamEnd(const std::weak_ptr<Connection> &weak)
+        {
+            PtrConnection conn = weak.lock();
+            if (conn == nullptr || conn->GetContext()->is<HTTPContext>() == false)
+                return;
+            conn->GetContext()->get<HTTPContext>()->SetStream(nullptr);
+            conn->ProcessInput();
+        }
+
+        // 请求头部接收完毕、正文到来之前：查找正文开始处理函数，由它设置正文接收器或者拒绝请求
+        // 没有拒绝时，带有 Expect: 100-continue 的客户端收到100之后才发送正文
+        void BodyStartHandler(HTTPRequest &req, HTTPResponse *rsp, Buffer *out)
+        {
+            int statu;
+            const BodyHandler *handler = _body_router.Find(req._method, req, &statu);
+            if (handler != nullptr)
+                (*handler)(req, rsp);
+            if (rsp->_statu >= 400)
+                return;
+            HTTPView expect = req.Header(HEADER_EXPECT);
+            if (expect.Empty())
+                return;
+            if (expect.EqualNoCase("100-continue") == false)
+            {
+                rsp->_statu = 417; // Expectation Failed
+                return;
+            }
+            if (req._version == HTTP_1_1)
+                out->WriteAndPush("HTTP/1.1 100 Continue\r\n\r\n", 25);
+        }
+
+        // 正文转存到文件结束，继续处理请求
+        void OnSpliced(const PtrConnection &conn, size_t len, bool ok)
+        {
+            if (conn->GetContext()->is<HTTPContext>())
+                conn->GetContext()->get<HTTPContext>()->Spliced(len, ok);
+        }
+
+        // 把一次处理中合并的应答交给连接，并立即写入套接字
+        void SendBatch(const PtrConnection &conn, Buffer *out)
+        {
+            conn->Append(out);
+            conn->Flush();
+        }
+
+        // 依次处理缓冲区中的请求，应答写入out，关闭连接之前先发送out中的应答
+        void HandleRequests(const PtrConnection &conn, Buffer *buf, Buffer *out)
+        {
+            while (true)
             {
                 // 1. 获取上下文
                 HTTPContext *context = conn->GetContext()->get<HTTPContext>();
+                // 先按顺序发送已经完成的排队应答
+                // 有响应正在流式发送、连接将要关闭或者排队的应答太多时，后续请求留在缓冲区中，等发送出去再处理
+                if (WriteQueued(conn, context, out) == false || context->Closing() || context->QueueSize() >= HTTP_PIPELINE_MAX)
+                    return;
                 // 2. 通过上下文对缓冲区数据进行分析，得到httpResponse对象
                 // 1. 如果缓冲区的数据解析出错，就直接响应出错相应信息
                 // 2. 如果解析正常，且请求已经获取完毕，才开始去进行处理
                 context->RecvHttpRequest(buf);
                 HTTPRequest &req = context->Request();
                 HTTPResponse rsp(context->RespStatu());
+                // 前面还有排队的应答时，带正文的请求等应答都发送出去再开始接收正文，100 Continue不会插到前面的应答之前
+                // 等待期间到达的正文会使缓冲区扩容或者移动数据，请求先把头部拷贝到自己的存储中，不再引用缓冲区
+                if (context->HeadReady() && context->Queued())
+                {
+                    req.Own();
+                    return;
+                }
+                // 带有正文的请求在头部接收完毕后先决定正文的去向，没有拒绝再开始接收正文
+                if (context->HeadReady() && rsp._statu < 400)
+                {
+                    BodyStartHandler(req, &rsp, out);
+                    if (rsp._statu < 400)
+                    {
+                        context->StartBody(buf);
+                        rsp._statu = context->RespStatu();
+                    }
+                }
 
-                if (context->RespStatu() >= 400)
+                if (rsp._statu >= 400)
                 {
-                    // 错误响应关闭连接
-                    ErrorHandler(req, &rsp);
-                    WriteResponse(conn, req, rsp);
+                    // 错误响应关闭连接，没有读取的正文直接丢弃
+                    if (rsp._body.empty())
+                        ErrorHandler(req, &rsp);
+                    if (context->Queued())
+                    {
+                        QueueRequest(conn, context, buf, nullptr, rsp);
+                        continue;
+                    }
+                    WriteResponse(conn, req, rsp, out);
                     context->ReSet();
                     buf->MoveReadOffset(buf->ReadAbleSize());
+                    SendBatch(conn, out);
                     conn->ShutDown();
                     return;
                 }
@@ -196,28 +772,73 @@ namespace my_muduo
                 if (context->RecvStatu() != RECV_HTTP_OVER)
                 {
                     // 当前请求还没有接收完整，则退出，等有新数据到来再重新处理
+                    // 写入文件的大块正文，缓冲区中的部分已经写入，剩余的从套接字直接转存到文件
+                    int fd = context->SpliceFd(buf, HTTP_SPLICE_MIN);
+                    if (fd >= 0)
+                        conn->SpliceTo(fd, context->BodyRemaining(), std::bind(&HTTPServer::OnSpliced, this, std::placeholders::_1,
+                                                                               std::placeholders::_2, std::placeholders::_3));
                     return;
                 }
                 // 3. 请求路由 + 业务处理
+                // 异步处理函数的应答，以及排在没有发送的应答之后的应答，都要排队按请求的顺序发送
+                const AsyncHandler *async = nullptr;
+                int statu;
+                if (req._method != HTTP_METHOD_COUNT)
+                    async = _async_router.Find(req._method, req, &statu);
+                if (async != nullptr || context->Queued())
+                {
+                    QueueRequest(conn, context, buf, async, rsp);
+                    if (buf->ReadAbleSize() > 0)
+                        continue;
+                    WriteQueued(conn, context, out);
+                    return;
+                }
                 Route(req, &rsp);
+                if (_compress)
+                    CompressHandler(req, &rsp);
                 // 4. 对HttpResponse进行组织发送
-                WriteResponse(conn, req, rsp);
-                // 5. 重置上下文
-                context->ReSet();
+                WriteResponse(conn, req, rsp, out);
+                // 5. 移除已处理的请求数据，重置上下文
+                context->Finish(buf);
+                // 流式响应还没有结束，由写入器在结束时关闭连接或者继续处理
+                if (rsp._stream && rsp._stream->Ended() == false)
+                {
+                    context->SetStream(rsp._stream);
+                    return;
+                }
                 // 6. 根据长短连接判断是否关闭连接或者继续处理
                 if (rsp.Close() == true)
+                {
+                    SendBatch(conn, out);
                     conn->ShutDown(); // 短连接则直接关闭
+                    return;
+                }
+                if (buf->ReadAbleSize() == 0)
+                    return;
             }
-            return;
+        }
+
+        // 缓冲区数据解析+处理
+        // 缓冲区为空时也可能被调用（正文转存到文件结束），这时处理已经接收完整的请求
+        // 流水线请求的应答合并在一个缓冲区中，全部处理完之后一次写出，而不是每个应答投递一次发送任务
+        void OnMessage(const PtrConnection &conn, Buffer *buf)
+        {
+            // LOGI("ReadAbleSize %d", buf->ReadAbleSize());
+            Buffer out;
+            HandleRequests(conn, buf, &out);
+            SendBatch(conn, &out);
         }
 
     public:
-        HTTPServer(int port, int timeout = DEFALT_TIMEOUT)
-            : _server(port)
+        // handoff_path 不为空时启用不停机重启，参见TCPServer
+        HTTPServer(int port, int timeout = DEFALT_TIMEOUT, const std::string &handoff_path = "")
+            : _server(port, handoff_path), _max_body(0), _compress(false), _compress_min(HTTP_COMPRESS_MIN),
+              _compress_types{"text/*", "application/json", "application/javascript", "application/xml", "image/svg+xml"}
         {
             _server.EnableInactiveRelease(timeout);
             _server.SetConnectionCallBack(std::bind(&HTTPServer::OnConnected, this, std::placeholders::_1));
             _server.SetMessageCallBack(std::bind(&HTTPServer::OnMessage, this, std::placeholders::_1, std::placeholders::_2));
+            _server.SetCloseCallBack(std::bind(&HTTPServer::OnClosed, this, std::placeholders::_1));
         }
         void SetBaseDir(const std::string &path)
         {
@@ -225,24 +846,128 @@ namespace my_muduo
             _basedir = path;
         }
 
+        // 设置静态文件内容缓存的内存上限，为0时不缓存内容，所有文件都用sendfile发送
+        void SetFileCache(size_t max_bytes)
+        {
+            _file_cache.Config(max_bytes);
+        }
+        // 设置打开文件缓存的文件个数上限（为0时不缓存）、校验文件是否修改的间隔和关闭不活跃文件的时间
+        void SetOpenFileCache(size_t max, int valid_ms = OPEN_FILE_CACHE_VALID_MS, int inactive_ms = OPEN_FILE_CACHE_INACTIVE_MS)
+        {
+            _open_cache.Config(max, valid_ms, inactive_ms);
+        }
+        /**
+         * @brief 启用动态响应的正文压缩（gzip/deflate），静态文件使用预压缩文件，不在这里压缩
+         * @param min_size[in]   正文不小于这个长度才压缩
+         * @param types[in]      可以压缩的正文类型，如 application/json，以 / 加星号结尾时匹配整个大类（所有 text/ 开头的类型），为空时使用默认的文本类型
+         * @return 空
+         */
+        void EnableCompress(size_t min_size = HTTP_COMPRESS_MIN, const std::vector<std::string> &types = {})
+        {
+            _compress = true;
+            _compress_min = min_size;
+            if (types.empty() == false)
+                _compress_types = types;
+        }
+        // 缓存的命中次数、未命中次数等统计信息
+        FileCache &GetFileCache() { return _file_cache; }
+        OpenFileCache &GetOpenFileCache() { return _open_cache; }
+
+        // 路径模式支持 :name（匹配一个路径段）、:name<int>（只匹配整数）和 *name（匹配剩余路径），
+        // 匹配到的值通过 HTTPRequest::PathParam 获取
+        void Handle(HttpMethod method, const std::string &pattern, const Handler &hanlder)
+        {
+            _router.Add(method, pattern, hanlder);
+        }
+
         void Get(const std::string &pattern, const Handler &hanlder)
         {
-            _get_route.push_back({std::regex(pattern), hanlder});
+            Handle(HTTP_GET, pattern, hanlder);
         }
 
         void Post(const std::string &pattern, const Handler &hanlder)
         {
-            _post_route.push_back({std::regex(pattern), hanlder});
+            Handle(HTTP_POST, pattern, hanlder);
         }
 
         void Put(const std::string &pattern, const Handler &hanlder)
         {
-            _put_route.push_back({std::regex(pattern), hanlder});
+            Handle(HTTP_PUT, pattern, hanlder);
         }
 
         void Delete(const std::string &pattern, const Handler &hanlder)
         {
-            _delete_route.push_back({std::regex(pattern), hanlder});
+            Handle(HTTP_DELETE, pattern, hanlder);
+        }
+
+        /**
+         * @brief 添加正文开始处理函数：带正文的请求头部接收完毕、正文到来之前调用，路径模式与Handle相同
+         *        处理函数中可以用 req.SetBodySink 设置正文接收器（正文不再保存到_body），
+         *        也可以把 rsp->_statu 设置为错误码直接拒绝，带 Expect: 100-continue 的客户端不会再发送正文
+         * @param method[in]     请求方法
+         * @param pattern[in]    路径模式
+         * @param handler[in]    正文开始处理函数，请求处理完成后仍然调用 Handle 添加的处理函数
+         * @return 空
+         */
+        void HandleBodyStart(HttpMethod method, const std::string &pattern, const BodyHandler &handler)
+        {
+            _body_router.Add(method, pattern, handler);
+        }
+
+        /**
+         * @brief 添加异步处理函数，路径模式与Handle相同，先于静态资源和其他路由查找
+         *        处理函数收到保存了请求和响应的应答对象，可以立即返回，在任意线程填充响应之后调用 Done，
+         *        等待期间loop线程继续处理其他连接和同一连接上的后续请求，应答仍然按请求的顺序发送
+         * @param method[in]     请求方法
+         * @param pattern[in]    路径模式
+         * @param handler[in]    异步处理函数
+         * @return 空
+         */
+        void HandleAsync(HttpMethod method, const std::string &pattern, const AsyncHandler &handler)
+        {
+            _async_router.Add(method, pattern, handler);
+        }
+
+        void GetAsync(const std::string &pattern, const AsyncHandler &handler)
+        {
+            HandleAsync(HTTP_GET, pattern, handler);
+        }
+
+        void PostAsync(const std::string &pattern, const AsyncHandler &handler)
+        {
+            HandleAsync(HTTP_POST, pattern, handler);
+        }
+
+        // 设置请求正文的长度上限，Content-Length超过时在接收正文之前应答413，为0时不限制
+        void SetMaxBodySize(size_t max_body)
+        {
+            _max_body = max_body;
+        }
+
+        // 正则路由，按添加顺序匹配，匹配结果保存在 HTTPRequest::_matches 中
+        void HandleRegex(HttpMethod method, const std::string &pattern, const Handler &hanlder)
+        {
+            _regex_route[method].push_back({std::regex(pattern), hanlder});
+        }
+
+        void GetRegex(const std::string &pattern, const Handler &hanlder)
+        {
+            HandleRegex(HTTP_GET, pattern, hanlder);
+        }
+
+        void PostRegex(const std::string &pattern, const Handler &hanlder)
+        {
+            HandleRegex(HTTP_POST, pattern, hanlder);
+        }
+
+        void PutRegex(const std::string &pattern, const Handler &hanlder)
+        {
+            HandleRegex(HTTP_PUT, pattern, hanlder);
+        }
+
+        void DeleteRegex(const std::string &pattern, const Handler &hanlder)
+        {
+            HandleRegex(HTTP_DELETE, pattern, hanlder);
         }
 
         void SetThreadCount(int count)
@@ -250,6 +975,27 @@ namespace my_muduo
             _server.SetThreadCount(count);
         }
 
+        // 设置连接上限，reject为true时达到上限后直接响应503并关闭连接，否则暂停获取新连接
+        void SetMaxConnections(size_t max_conns, size_t max_conns_per_loop = 0, bool reject = false)
+        {
+            _server.SetMaxConnections(max_conns, max_conns_per_loop);
+            if (reject)
+                _server.SetOverloadPolicy(OVERLOAD_REJECT, "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            else
+                _server.SetOverloadPolicy(OVERLOAD_PAUSE_ACCEPT);
+        }
+
+        // 设置交出监听套接字后，等待已有连接处理完毕的最长时间
+        void SetHandoffGrace(int sec)
+        {
+            _server.SetHandoffGrace(sec);
+        }
+        // 设置回收从属线程时，等待连接迁移走的最长时间
+        void SetDrainGrace(int sec)
+        {
+            _server.SetDrainGrace(sec);
+        }
+
         void Listen()
         {
             _server.Start();
@@ -0,0 +1,251 @@
+#pragma once
+
+#include "TCPServer.h"
+#include "HTTPCompress.h"
+#include <functional>
+
+namespace my_muduo
+{
+#define HTTP_STREAM_HIGH_MARK (256 << 10) // 待发送数据超过这个量时Writable返回false，生产者暂停写入
+#define HTTP_STREAM_LOW_MARK (64 << 10)   // 待发送数据降到这个量以下时通知生产者继续写入
+#define HTTP_STREAM_MOVE_MIN 4096         // 不小于这个长度的数据移动给连接发送，更小的和分块头部拷贝到一起
+
+    /* 流式响应写入器：处理函数通过 HTTPResponse::Stream 得到，可以保存下来分多次写入，最后调用End结束。
+     * HTTP/1.1 使用 Transfer-Encoding: chunked 发送，HTTP/1.0 或者处理函数设置了Content-Length时直接发送正文；
+     * 待发送的数据超过高水位时Writable返回false，数据发送到低水位以下时调用可写回调，生产者在回调中继续写入，
+     * 内存占用只与水位有关，不随响应大小增长。
+     * 所有接口都必须在连接所属的loop线程中调用（处理函数和可写回调中都是），其他线程产生的数据需要投递到loop中写入。 */
+    class HTTPStream : public std::enable_shared_from_this<HTTPStream>
+    {
+    public:
+        using WritableCallBack = std::function<void(HTTPStream &)>;
+        using FinishCallBack = std::function<void()>;
+
+    private:
+        std::weak_ptr<Connection> _conn; // 开始发送之后绑定的连接，连接关闭后失效
+        bool _started;                   // 头部已经发送，之后写入的数据直接交给连接
+        bool _chunked;                   // 是否使用分块传输
+        bool _close;                     // 结束后关闭连接（HTTP/1.0没有长度时只能用关闭连接表示结束）
+        bool _ended;                     // 已经结束或者不需要正文（HEAD、304），之后的写入被丢弃
+        bool _armed;                     // 已经在连接上等待可写通知
+        std::string _pending;            // 开始发送之前写入的原始数据，开始时再压缩和分块
+        std::unique_ptr<Deflater> _deflater; // 边写边压缩，为空时不压缩
+        WritableCallBack _writable;
+        FinishCallBack _finish; // 服务器设置：响应结束后继续处理后续的请求
+
+    private:
+        // 结束时释放回调和压缩器，回调中往往持有写入器本身，不释放会形成循环引用
+        void Release()
+        {
+            _writable = nullptr;
+            _finish = nullptr;
+            if (_deflater)
+                DeflaterPool::Put(std::move(_deflater));
+        }
+
+        // 发送一段已经编码好的正文数据，分块传输时加上分块头部和结尾
+        void Emit(std::string &&data)
+        {
+            if (data.empty())
+                return;
+            PtrConnection conn = _conn.lock();
+            if (conn == nullptr)
+                return;
+            Buffer buf;
+            if (_chunked)
+            {
+                char head[32];
+                int len = snprintf(head, sizeof(head), "%zx\r\n", data.size());
+                buf.WriteAndPush(head, len);
+            }
+            if (data.size() < HTTP_STREAM_MOVE_MIN)
+            {
+                buf.WriteStringAndPush(data);
+                if (_chunked)
+                    buf.WriteAndPush("\r\n", 2);
+                return conn->Send(std::move(buf));
+            }
+            if (buf.ReadAbleSize() > 0)
+                conn->Send(std::move(buf));
+            conn->Send(std::move(data));
+            if (_chunked)
+                conn->Send("\r\n", 2);
+        }
+
+        // 压缩（需要时）之后发送
+        void Encode(const char *data, size_t len)
+        {
+            if (_deflater == nullptr)
+                return Emit(std::string(data, len));
+            std::string out;
+            _deflater->Update(data, len, &out, true);
+            Emit(std::move(out));
+        }
+
+        // 输出压缩器中剩余的数据和分块传输的结尾
+        void Terminate(const PtrConnection &conn)
+        {
+            if (_deflater)
+            {
+                std::string out;
+                _deflater->Finish(&out);
+                Emit(std::move(out));
+            }
+            if (_chunked)
+                conn->Send("0\r\n\r\n", 5);
+        }
+
+        // 待发送的数据超过高水位时等待连接的可写通知，到了低水位再调用可写回调
+        void Arm()
+        {
+            PtrConnection conn = _conn.lock();
+            if (_armed || _ended || _writable == nullptr || conn == nullptr)
+                return;
+            _armed = true;
+            conn->SetDrainCallBack(HTTP_STREAM_LOW_MARK, std::bind(&HTTPStream::OnDrain, shared_from_this()));
+        }
+        void OnDrain()
+        {
+            _armed = false;
+            if (_ended || _writable == nullptr)
+                return;
+            WritableCallBack cb = _writable; // 回调中可能调用End释放回调本身
+            cb(*this);
+            if (_ended == false && Writable() == false)
+                Arm();
+        }
+
+    public:
+        HTTPStream() : _started(false), _chunked(true), _close(false), _ended(false), _armed(false) {}
+        HTTPStream(const HTTPStream &) = delete;
+        HTTPStream &operator=(const HTTPStream &) = delete;
+
+        /**
+         * @brief 设置可写回调，开始发送之后以及每次待发送的数据降到低水位以下时调用，生产者在回调中写入直到Writable返回false
+         * @param cb[in]         可写回调，数据全部写完后在回调中调用End
+         * @return 空
+         */
+        void SetWritableCallBack(const WritableCallBack &cb) { _writable = cb; }
+
+        // 是否可以继续写入，为false时应该暂停，等待可写回调
+        bool Writable()
+        {
+            if (_ended)
+                return false;
+            if (_started == false)
+                return _pending.size() < HTTP_STREAM_HIGH_MARK;
+            PtrConnection conn = _conn.lock();
+            return conn && conn->Connected() && conn->OutBytes() < HTTP_STREAM_HIGH_MARK;
+        }
+        // 响应是否已经结束，连接关闭或者不需要正文时也返回true，生产者应该停止
+        bool Ended() { return _ended || (_started && (_conn.expired() || _conn.lock()->Connected() == false)); }
+
+        /**
+         * @brief 写入一段正文数据，超过高水位时仍然会写入，但是生产者应该检查Writable并暂停
+         * @param data[in]       数据
+         * @param len[in]        数据长度
+         * @return 响应已经结束（连接关闭、HEAD请求等）时返回false，数据被丢弃
+         */
+        bool Write(const char *data, size_t len)
+        {
+            if (Ended())
+                return false;
+            if (len == 0)
+                return true;
+            if (_started == false)
+                _pending.append(data, len);
+            else
+                Encode(data, len);
+            if (Writable() == false)
+                Arm();
+            return true;
+        }
+        bool Write(const std::string &data) { return Write(data.data(), data.size()); }
+        // 大块数据移动进来，不压缩时不再拷贝
+        bool Write(std::string &&data)
+        {
+            if (Ended())
+                return false;
+            if (_deflater || _started == false)
+                return Write(data.data(), data.size());
+            Emit(std::move(data));
+            if (Writable() == false)
+                Arm();
+            return true;
+        }
+
+        // 结束响应：输出压缩器中剩余的数据和分块传输的结尾，之后继续处理同一连接上的后续请求
+        void End()
+        {
+            if (_ended)
+                return;
+            _ended = true;
+            if (_started == false)
+                return; // 还没有开始发送，由Start一起发送
+            FinishCallBack finish = _finish;
+            PtrConnection conn = _conn.lock();
+            if (conn)
+                Terminate(conn);
+            Release();
+            if (conn == nullptr)
+                return;
+            if (_close)
+                conn->ShutDown();
+            if (finish)
+                finish();
+        }
+
+        // 以下接口由服务器调用
+
+        // 设置压缩格式，开始发送之前由服务器根据Accept-Encoding设置
+        void Compress(CompressType type) { _deflater = DeflaterPool::Get(type); }
+
+        /**
+         * @brief 头部发送之后开始发送正文：先发送开始之前写入的数据，没有结束时等待连接可写再调用可写回调
+         * @param conn[in]       发送响应的连接
+         * @param chunked[in]    是否使用分块传输
+         * @param close[in]      结束后是否关闭连接
+         * @param discard[in]    不需要正文（HEAD请求、304等），直接结束
+         * @param finish[in]     流式发送结束后的回调，Start返回时已经结束则不会调用
+         * @return 已经结束返回true，否则返回false，服务器需要暂停处理这个连接上的后续请求
+         */
+        bool Start(const PtrConnection &conn, bool chunked, bool close, bool discard, const FinishCallBack &finish)
+        {
+            _conn = conn;
+            _chunked = chunked;
+            _close = close;
+            _started = true;
+            if (discard)
+            {
+                _pending.clear();
+                _ended = true;
+                Release();
+                return true;
+            }
+            if (_pending.empty() == false)
+                Encode(_pending.data(), _pending.size());
+            _pending = std::string();
+            if (_ended)
+            {
+                Terminate(conn);
+                Release();
+                return true;
+            }
+            _finish = finish;
+            if (_writable)
+            {
+                _armed = true;
+                conn->SetDrainCallBack(HTTP_STREAM_HIGH_MARK, std::bind(&HTTPStream::OnDrain, shared_from_this()));
+            }
+            return false;
+        }
+
+        // 连接关闭，丢弃没有发送的数据，释放回调
+        void Abort()
+        {
+            _ended = true;
+            _pending.clear();
+            Release();
+        }
+    };
+}
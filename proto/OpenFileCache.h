@@ -0,0 +1,268 @@
+#pragma once
+
+#include "Util.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <unordered_map>
+
+namespace my_muduo
+{
+#define OPEN_FILE_CACHE_MAX 1024              // 最多缓存的文件个数
+#define OPEN_FILE_CACHE_VALID_MS 1000         // 缓存的stat结果多久之后需要重新校验
+#define OPEN_FILE_CACHE_INACTIVE_MS (60 * 1000) // 多久没有被访问的文件关闭描述符
+
+    // 预压缩文件的编码，按优先级排列
+    typedef enum
+    {
+        ENCODING_BR,   // 同名的 .br 文件
+        ENCODING_GZIP, // 同名的 .gz 文件
+        ENCODING_COUNT
+    } FileEncoding;
+
+    // 打开的文件，最后一个引用释放时关闭描述符，正在发送的文件即使被淘汰也不会提前关闭
+    struct OpenFile
+    {
+        std::string path;
+        int fd;
+        struct stat st;
+        std::string mime;
+        std::string encoding;      // 内容编码，原文件为空
+        bool vary;                 // 是否有预压缩文件，有时响应需要带上 Vary: Accept-Encoding
+        std::string etag;          // 由inode、大小和修改时间生成的强验证器
+        std::string last_modified; // HTTP日期格式的修改时间
+        std::string headers;       // 预先组织好的完整文件响应的头部，包含\r\n
+        // 预压缩的同名文件，不存在时为空，与原文件一起打开、一起校验
+        std::shared_ptr<const OpenFile> encoded[ENCODING_COUNT];
+
+        OpenFile() : fd(-1), vary(false) {}
+        ~OpenFile()
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+        OpenFile(const OpenFile &) = delete;
+        OpenFile &operator=(const OpenFile &) = delete;
+
+        // 是否是同一个文件的同一个版本
+        bool Same(const struct stat &other) const
+        {
+            return st.st_ino == other.st_ino && st.st_dev == other.st_dev && st.st_size == other.st_size &&
+                   st.st_mtim.tv_sec == other.st_mtim.tv_sec && st.st_mtim.tv_nsec == other.st_mtim.tv_nsec;
+        }
+    };
+
+    /* 打开文件缓存（类似nginx的open_file_cache）：
+     * 缓存热点路径的描述符和stat结果，未到校验时间时查找不产生任何系统调用；
+     * 到了校验时间用stat重新校验，文件没有变化时继续使用原来的描述符，变化了才重新打开；
+     * 同名的 .br/.gz 预压缩文件与原文件一起打开和校验，内容协商不需要额外访问文件系统；
+     * 按LRU淘汰超出个数上限的文件，长时间没有访问的文件在查找时顺便关闭。 */
+    class OpenFileCache
+    {
+    private:
+        struct Node
+        {
+            std::shared_ptr<const OpenFile> file;
+            int64_t checked_ms; // 上次校验的时间
+            int64_t used_ms;    // 上次访问的时间
+        };
+        using NodeList = std::list<Node>;
+
+        std::mutex _mutex;
+        NodeList _lru; // 越靠前越是最近使用的
+        std::unordered_map<std::string, NodeList::iterator> _index;
+        size_t _max;     // 缓存的文件个数上限，为0时不缓存
+        int _valid_ms;   // 校验间隔
+        int _inactive_ms; // 不活跃时间
+        uint64_t _hits;
+        uint64_t _misses;
+
+    private:
+        static int64_t NowMs()
+        {
+            using namespace std::chrono;
+            return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+        }
+
+        static const char *EncodingExt(int encoding) { return encoding == ENCODING_BR ? ".br" : ".gz"; }
+        static const char *EncodingName(int encoding) { return encoding == ENCODING_BR ? "br" : "gzip"; }
+
+        // 打开一个文件，预压缩文件的类型使用原文件的类型
+        static std::shared_ptr<OpenFile> OpenOne(const std::string &path, const std::string &mime, int encoding, bool vary)
+        {
+            std::shared_ptr<OpenFile> file = std::make_shared<OpenFile>();
+            file->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (file->fd < 0)
+                return nullptr;
+            // 使用打开的描述符获取属性，与实际读取的文件一致
+            if (fstat(file->fd, &file->st) < 0 || S_ISREG(file->st.st_mode) == false)
+                return nullptr;
+            file->path = path;
+            file->mime = mime;
+            file->encoding = encoding == ENCODING_COUNT ? "" : EncodingName(encoding);
+            file->vary = vary;
+            file->headers = "Content-Type: " + file->mime + "\r\n";
+            file->headers += "Content-Length: " + std::to_string(file->st.st_size) + "\r\n";
+            if (file->encoding.empty() == false)
+                file->headers += "Content-Encoding: " + file->encoding + "\r\n";
+            if (file->vary)
+                file->headers += "Vary: Accept-Encoding\r\n";
+            char etag[64];
+            snprintf(etag, sizeof(etag), "\"%lx-%lx-%lx\"", (unsigned long)file->st.st_ino,
+                     (unsigned long)file->st.st_size, (unsigned long)file->st.st_mtime);
+            file->etag = etag;
+            file->last_modified = Util::HttpDate(file->st.st_mtime);
+            file->headers += "ETag: " + file->etag + "\r\n";
+            file->headers += "Last-Modified: " + file->last_modified + "\r\n";
+            file->headers += "Accept-Ranges: bytes\r\n";
+            return file;
+        }
+
+        // 打开文件和它的预压缩文件，有预压缩文件时所有的响应都带上 Vary: Accept-Encoding
+        static std::shared_ptr<const OpenFile> Open(const std::string &path)
+        {
+            std::string mime = Util::ExtMime(path);
+            std::shared_ptr<OpenFile> encoded[ENCODING_COUNT];
+            bool vary = false;
+            for (int i = 0; i < ENCODING_COUNT; i++)
+            {
+                encoded[i] = OpenOne(path + EncodingExt(i), mime, i, true);
+                vary = vary || encoded[i];
+            }
+            std::shared_ptr<OpenFile> file = OpenOne(path, mime, ENCODING_COUNT, vary);
+            if (file == nullptr)
+                return nullptr;
+            for (int i = 0; i < ENCODING_COUNT; i++)
+                file->encoded[i] = encoded[i];
+            return file;
+        }
+
+        // 原文件和预压缩文件都没有变化（包括预压缩文件的新增和删除）
+        static bool Unchanged(const OpenFile &file)
+        {
+            struct stat st;
+            if (stat(file.path.c_str(), &st) < 0 || file.Same(st) == false)
+                return false;
+            for (int i = 0; i < ENCODING_COUNT; i++)
+            {
+                bool exist = stat((file.path + EncodingExt(i)).c_str(), &st) == 0 && S_ISREG(st.st_mode);
+                if (exist != (file.encoded[i] != nullptr))
+                    return false;
+                if (exist && file.encoded[i]->Same(st) == false)
+                    return false;
+            }
+            return true;
+        }
+
+        // 删除节点，调用时需要持有锁
+        void Erase(NodeList::iterator it)
+        {
+            _index.erase(it->file->path);
+            _lru.erase(it);
+        }
+
+        // 淘汰超出个数上限和长时间没有访问的文件，调用时需要持有锁
+        void Shrink(int64_t now)
+        {
+            while (_lru.empty() == false && (_lru.size() > _max || now - _lru.back().used_ms >= _inactive_ms))
+                Erase(std::prev(_lru.end()));
+        }
+
+    public:
+        OpenFileCache(size_t max = OPEN_FILE_CACHE_MAX, int valid_ms = OPEN_FILE_CACHE_VALID_MS,
+                      int inactive_ms = OPEN_FILE_CACHE_INACTIVE_MS)
+            : _max(max), _valid_ms(valid_ms), _inactive_ms(inactive_ms), _hits(0), _misses(0) {}
+
+        /**
+         * @brief 修改缓存配置
+         * @param max[in]            缓存的文件个数上限，为0时不缓存
+         * @param valid_ms[in]       校验间隔，为0时每次都校验
+         * @param inactive_ms[in]    多久没有访问的文件关闭描述符
+         * @return 空
+         */
+        void Config(size_t max, int valid_ms, int inactive_ms = OPEN_FILE_CACHE_INACTIVE_MS)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _max = max;
+            _valid_ms = valid_ms;
+            _inactive_ms = inactive_ms;
+            Shrink(NowMs());
+        }
+
+        /**
+         * @brief 查找并打开文件
+         * @param path[in]       文件的实际路径
+         * @param file[out]      打开的文件
+         * @return 文件存在且是普通文件时返回true
+         */
+        bool Lookup(const std::string &path, std::shared_ptr<const OpenFile> *file)
+        {
+            int64_t now = NowMs();
+            std::shared_ptr<const OpenFile> cached;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                Shrink(now);
+                auto it = _index.find(path);
+                if (it != _index.end())
+                {
+                    _lru.splice(_lru.begin(), _lru, it->second);
+                    it->second->used_ms = now;
+                    if (now - it->second->checked_ms < _valid_ms)
+                    {
+                        _hits++;
+                        *file = it->second->file;
+                        return true;
+                    }
+                    cached = it->second->file;
+                }
+            }
+            // 到了校验时间，文件没有变化时继续使用原来的描述符
+            if (cached && Unchanged(*cached))
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto it = _index.find(path);
+                if (it != _index.end() && it->second->file == cached)
+                    it->second->checked_ms = now;
+                _hits++;
+                *file = cached;
+                return true;
+            }
+            std::shared_ptr<const OpenFile> opened = Open(path);
+            std::unique_lock<std::mutex> lock(_mutex);
+            _misses++;
+            auto it = _index.find(path);
+            if (it != _index.end())
+                Erase(it->second);
+            *file = opened;
+            if (opened == nullptr)
+                return false;
+            if (_max > 0)
+            {
+                _lru.push_front(Node{opened, now, now});
+                _index[path] = _lru.begin();
+                Shrink(now);
+            }
+            return true;
+        }
+
+        uint64_t Hits()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _hits;
+        }
+        uint64_t Misses()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _misses;
+        }
+        size_t Count()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _lru.size();
+        }
+    };
+}
@@ -2,6 +2,7 @@
 
 #include "TCPServer.h"
 #include <sys/stat.h>
+#include <ctime>
 
 namespace my_muduo
 {
@@ -286,29 +287,42 @@ namespace my_muduo
         }
 
         /**
-         * @brief URL 解码
+         * @brief URL 解码，结果写入out，out原有的空间可以重复使用
          * @param url[in]       源URL
-         * @return 返回解码后的 URL
+         * @param len[in]       源URL长度
+         * @param convert_plus_to_space[in]    是否把 + 转换为空格（查询字符串中需要）
+         * @param out[out]      解码后的 URL
+         * @return 空
          */
-        static std::string UrlDecode(const std::string url, bool convert_space_to_plus)
+        static void UrlDecode(const char *url, size_t len, bool convert_plus_to_space, std::string *out)
         {
-            std::string res;
-            for (int i = 0; i < url.size(); i++)
+            out->clear();
+            for (size_t i = 0; i < len; i++)
             {
-                if (url[i] == ' ' && convert_space_to_plus)
-                    res += '+';
-
-                if (url[i] == '%' && i + 2 < url.size())
+                if (url[i] == '+' && convert_plus_to_space)
+                {
+                    out->push_back(' ');
+                    continue;
+                }
+                if (url[i] == '%' && i + 2 < len && HexToI(url[i + 1]) >= 0 && HexToI(url[i + 2]) >= 0)
                 {
-                    char v1 = HexToI(url[i + 1]);
-                    char v2 = HexToI(url[i + 2]);
-                    char v = (v1 << 4) + v2;
-                    res += v;
+                    out->push_back((HexToI(url[i + 1]) << 4) + HexToI(url[i + 2]));
                     i += 2;
                     continue;
                 }
-                res += url[i];
+                out->push_back(url[i]);
             }
+        }
+
+        /**
+         * @brief URL 解码
+         * @param url[in]       源URL
+         * @return 返回解码后的 URL
+         */
+        static std::string UrlDecode(const std::string url, bool convert_plus_to_space)
+        {
+            std::string res;
+            UrlDecode(url.data(), url.size(), convert_plus_to_space, &res);
             return res;
         }
 
@@ -326,6 +340,123 @@ namespace my_muduo
                 return "UnKnown";
         }
 
+        /**
+         * @brief                获取完整的响应状态行，所有状态行在第一次调用时生成好，之后只是查表
+         * @param statu[in]      状态码，不在100~599之间时按500处理
+         * @param minor[in]      HTTP/1.x 的次版本号，0或1
+         * @return 状态行，包含结尾的\r\n
+         */
+        static const std::string &StatuLine(int statu, int minor = 1)
+        {
+            static const std::vector<std::string> lines = []()
+            {
+                std::vector<std::string> lines;
+                for (int m = 0; m < 2; m++)
+                {
+                    for (int code = 100; code < 600; code++)
+                        lines.push_back("HTTP/1." + std::to_string(m) + " " + std::to_string(code) + " " + StatuDesc(code) + "\r\n");
+                }
+                return lines;
+            }();
+            if (statu < 100 || statu >= 600)
+                statu = 500;
+            return lines[(minor == 0 ? 0 : 500) + statu - 100];
+        }
+
+        /**
+         * @brief                将时间转换为HTTP日期格式，如 Sun, 06 Nov 1994 08:49:37 GMT
+         * @param t[in]          时间
+         * @return 日期字符串
+         */
+        static std::string HttpDate(time_t t)
+        {
+            struct tm tm;
+            char date[32];
+            gmtime_r(&t, &tm);
+            strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+            return date;
+        }
+
+        /**
+         * @brief                解析HTTP日期格式，如 Sun, 06 Nov 1994 08:49:37 GMT
+         * @param date[in]       日期字符串
+         * @param len[in]        字符串长度
+         * @param t[out]         解析得到的时间
+         * @return 格式正确返回true
+         */
+        static bool ParseHttpDate(const char *date, size_t len, time_t *t)
+        {
+            char buf[64];
+            if (len == 0 || len >= sizeof(buf))
+                return false;
+            memcpy(buf, date, len);
+            buf[len] = '\0';
+            struct tm tm;
+            memset(&tm, 0, sizeof(tm));
+            const char *end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+            if (end == nullptr || *end != '\0')
+                return false;
+            *t = timegm(&tm);
+            return true;
+        }
+
+        /**
+         * @brief                判断If-None-Match中是否有与etag匹配的实体标签，使用弱比较（忽略W/前缀）
+         * @param list[in]       If-None-Match头部的值，逗号分隔的实体标签列表或者*
+         * @param len[in]        头部值的长度
+         * @param etag[in]       当前的实体标签，包含双引号
+         * @return 匹配返回true
+         */
+        static bool ETagMatch(const char *list, size_t len, const std::string &etag)
+        {
+            const char *p = list, *end = list + len;
+            const char *tag = etag.c_str();
+            size_t tag_len = etag.size();
+            if (tag_len > 2 && tag[0] == 'W' && tag[1] == '/')
+            {
+                tag += 2;
+                tag_len -= 2;
+            }
+            while (p < end)
+            {
+                while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+                    p++;
+                const char *start = p;
+                while (p < end && *p != ',')
+                    p++;
+                const char *stop = p;
+                while (stop > start && (stop[-1] == ' ' || stop[-1] == '\t'))
+                    stop--;
+                if (stop - start == 1 && *start == '*')
+                    return true;
+                if (stop - start > 2 && start[0] == 'W' && start[1] == '/')
+                    start += 2;
+                if ((size_t)(stop - start) == tag_len && memcmp(start, tag, tag_len) == 0)
+                    return true;
+            }
+            return false;
+        }
+
+        /**
+         * @brief                获取当前时间的HTTP日期格式，如 Sun, 06 Nov 1994 08:49:37 GMT
+         * @param 空
+         * @return 日期字符串，长度固定为29，每个线程每秒只格式化一次
+         */
+        static const char *HttpDate()
+        {
+            static thread_local time_t last = 0;
+            static thread_local char date[32];
+            time_t now = time(nullptr);
+            if (now != last)
+            {
+                struct tm tm;
+                gmtime_r(&now, &tm);
+                strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+                last = now;
+            }
+            return date;
+        }
+
         /**
          * @brief                根据文件后缀名获取文件mime
          * @param filename[in]   文件名
@@ -5,31 +5,115 @@
 
 namespace my_muduo
 {
+#define MAX_ACCEPT_PER_LOOP 64 // 每次可读事件最多获取的新连接数量，避免监听套接字长时间占用baseloop
+#define ACCEPT_BACKOFF_SEC 1   // 描述符耗尽且没有预留描述符时，暂停获取新连接的秒数
+
     class Acceptor
     {
     private:
         Sock _socket;
         EventLoop* _loop;
         Channel _channel;
+        int _idle_fd;           // 预留的空闲描述符，描述符耗尽(EMFILE)时用来接收并关闭新连接
+        int _max_accept;        // 每次可读事件最多获取的新连接数量
+        bool _paused;           // 是否暂停获取新连接（过载保护）
+        bool _backoff;          // 描述符耗尽且没有预留描述符，暂时关闭了读事件监控，定时器到期后恢复
 
         using AcceptCallback = std::function<void(int)>;
         AcceptCallback _accept_callback;
     
     private:
-        // 监听套接字的读事件回调处理函数 —— 获取新链接，调用_accept_callback函数进行新链接处理。
-        void HandlerRead()
+        static int CreateIdleFd()
+        {
+            int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                LOGW("open idle fd failed: %s", strerror(errno));
+            return fd;
+        }
+
+        // 描述符耗尽时，监听套接字会一直可读，如果不处理就会导致事件循环空转
+        // 先释放预留的描述符，把新连接获取上来直接关闭，再重新预留一个描述符
+        // 预留描述符失败时先重试，仍然没有就暂停获取新连接一段时间，返回false
+        bool DropConnection()
         {
-            int newfd = _socket.Accept();
-            if(newfd < 0)
+            if (_idle_fd < 0)
+                _idle_fd = CreateIdleFd();
+            if (_idle_fd < 0)
+            {
+                Backoff();
+                return false;
+            }
+            close(_idle_fd);
+            int fd = accept(_socket.Fd(), NULL, NULL);
+            if (fd >= 0)
+                close(fd);
+            _idle_fd = CreateIdleFd();
+            LOGW("too many open files, drop new connection");
+            return true;
+        }
+
+        // 关闭监听套接字的读事件监控，定时器到期后再恢复，期间新连接留在全连接队列中
+        void Backoff()
+        {
+            if (_backoff)
                 return;
+            _backoff = true;
+            _channel.DisableRead();
+            LOGW("too many open files and no idle fd, stop accepting for %d seconds", ACCEPT_BACKOFF_SEC);
+            _loop->TimerAdd(_loop->NextId(), ACCEPT_BACKOFF_SEC, std::bind(&Acceptor::EndBackoff, this));
+        }
+        void EndBackoff()
+        {
+            _backoff = false;
+            // 期间被暂停或者停止时，由Resume恢复或者不再恢复
+            if (_paused == false && _socket.Fd() >= 0)
+                _channel.EnableRead();
+        }
+
+        // 监听套接字的读事件回调处理函数 —— 批量获取新链接，调用_accept_callback函数进行新链接处理。
+        void HandlerRead()
+        {
+            for (int i = 0; i < _max_accept; i++)
+            {
+                int newfd = _socket.Accept();
+                if (newfd < 0)
+                {
+                    if (errno == EINTR || errno == ECONNABORTED)
+                        continue;
+                    if (errno == EMFILE || errno == ENFILE)
+                    {
+                        if (DropConnection() == false)
+                            return;
+                        continue;
+                    }
+                    // EAGAIN 全连接队列已经取空了
+                    return;
+                }
 
-            if(_accept_callback) 
-                _accept_callback(newfd);
+                // 之前预留描述符失败，有描述符可用时再补上
+                if (_idle_fd < 0)
+                    _idle_fd = CreateIdleFd();
+                if (_accept_callback)
+                    _accept_callback(newfd);
+                else
+                    close(newfd);
+                // 回调中有可能因为过载暂停了获取新连接，剩下的连接留在全连接队列中
+                if (_paused)
+                    return;
+            }
         }
 
-        int CreaterServer(uint16_t port)
+        int CreaterServer(uint16_t port, int listen_fd)
         {
-            bool ret = _socket.CreateServer(port);
+            // 使用从其他进程继承的监听套接字，不再重新创建
+            if (listen_fd >= 0)
+            {
+                int flag = fcntl(listen_fd, F_GETFL, 0);
+                fcntl(listen_fd, F_SETFL, flag | O_NONBLOCK);
+                return listen_fd;
+            }
+            // 监听套接字必须是非阻塞的，否则批量获取新连接时，取空了全连接队列就会阻塞住baseloop
+            bool ret = _socket.CreateServer(port, "0.0.0.0", true);
             assert(ret == true);
             return _socket.Fd();
         }
@@ -37,20 +121,71 @@ namespace my_muduo
     public:
         // 不能将启动读事件监控，放到构造函数中，必须设置回调函数后，再去启动
         // 否则有可能造成启动监控后，立即有事件，处理的时候，回调函数还没设置，新链接得不到处理，且资源泄露。
-        Acceptor(EventLoop* loop, uint16_t port)
-            :_loop(loop), _socket(CreaterServer(port)), _channel(loop, _socket.Fd())
+        // listen_fd >= 0 时直接使用这个已经在监听的套接字（例如从旧进程继承而来）
+        Acceptor(EventLoop* loop, uint16_t port, int listen_fd = -1)
+            :_loop(loop), _socket(CreaterServer(port, listen_fd)), _channel(loop, _socket.Fd()),
+             _idle_fd(CreateIdleFd()), _max_accept(MAX_ACCEPT_PER_LOOP), _paused(false), _backoff(false)
         {
             _channel.SetReadCallBack(std::bind(&Acceptor::HandlerRead, this));
         }  
 
+        ~Acceptor()
+        {
+            if (_idle_fd >= 0)
+                close(_idle_fd);
+        }
+
         void SetAcceptCallback(const AcceptCallback& cb)
         {
             _accept_callback = cb;
         }
 
+        // 设置每次可读事件最多获取的新连接数量
+        void SetMaxAcceptPerLoop(int count)
+        {
+            _max_accept = count > 0 ? count : 1;
+        }
+
         void Listen()
         {
-            _channel.EnableRead();
+            _paused = false;
+            if (_backoff == false)
+                _channel.EnableRead();
+        }
+
+        // 暂停获取新连接：关闭监听套接字的读事件监控，新连接留在内核的全连接队列中（必须在loop线程中调用）
+        void Pause()
+        {
+            if (_paused)
+                return;
+            _paused = true;
+            if (_backoff == false)
+                _channel.DisableRead();
+        }
+
+        // 恢复获取新连接（必须在loop线程中调用）
+        void Resume()
+        {
+            if (_paused == false)
+                return;
+            _paused = false;
+            if (_backoff == false)
+                _channel.EnableRead();
+        }
+
+        bool Paused() { return _paused; }
+
+        int Fd() { return _socket.Fd(); }
+
+        // 停止获取新连接并关闭监听套接字（必须在loop线程中调用）
+        // 监听套接字已经交给其他进程时，关闭的只是当前进程的引用，全连接队列不受影响
+        void Stop()
+        {
+            if (_socket.Fd() < 0)
+                return;
+            _paused = true;
+            _channel.Remove();
+            _socket.Close();
         }
     };
 }
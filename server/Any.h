@@ -2,75 +2,211 @@
 
 #include <iostream>
 #include <cassert>
-#include <typeinfo>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <type_traits>
 
 namespace my_muduo
 {
-    class Any
+#define ANY_INLINE_SIZE (3 * sizeof(void *)) // 默认内联存储的大小
+
+    // 小对象直接存放在内联缓冲区中，放不下或者移动构造可能抛异常的类型才在堆上分配
+    // 每种类型对应一张静态的操作表，表的地址同时作为类型标识，不依赖RTTI
+    template <size_t Size>
+    class BasicAny
     {
     private:
-        class holder
+        union Storage
         {
-        public:
-            virtual ~holder() {}
-            virtual const std::type_info &type() = 0;
-            virtual holder *clone() = 0;
+            typename std::aligned_storage<Size, alignof(std::max_align_t)>::type buf;
+            void *ptr;
         };
 
-        template <class T>
-        class placeholder : public holder
+        struct Ops
         {
-        public:
-            placeholder(const T &val) : _val(val) {}
+            void (*destroy)(Storage &self);
+            void (*copy)(Storage &dst, const Storage &src); // 不可拷贝的类型为CopyFail
+            void (*move)(Storage &dst, Storage &src);       // 移动后src中的对象已经析构
+        };
 
-            // 获取子类对象保存的数据类型
-            virtual const std::type_info &type() { return typeid(T); }
+        template <class T>
+        struct IsInline
+        {
+            static const bool value = sizeof(T) <= Size && alignof(T) <= alignof(std::max_align_t) &&
+                                      std::is_nothrow_move_constructible<T>::value;
+        };
 
-            // 针对当前的对象自身，克隆出一个新的子类对象
-            virtual holder *clone() { return new placeholder(_val); }
+        // 内联存储
+        template <class T, bool = IsInline<T>::value>
+        struct Manager
+        {
+            static T *Get(Storage &s) { return reinterpret_cast<T *>(&s.buf); }
+            template <class... Args>
+            static void Create(Storage &s, Args &&...args) { ::new (&s.buf) T(std::forward<Args>(args)...); }
+            static void Destroy(Storage &s) { Get(s)->~T(); }
+            static void Copy(Storage &dst, const Storage &src) { Create(dst, *Get(const_cast<Storage &>(src))); }
+            static void Move(Storage &dst, Storage &src)
+            {
+                Create(dst, std::move(*Get(src)));
+                Destroy(src);
+            }
+            static const Ops ops;
+        };
 
-        public:
-            T _val;
+        // 堆上存储
+        template <class T>
+        struct Manager<T, false>
+        {
+            static T *Get(Storage &s) { return static_cast<T *>(s.ptr); }
+            template <class... Args>
+            static void Create(Storage &s, Args &&...args) { s.ptr = new T(std::forward<Args>(args)...); }
+            static void Destroy(Storage &s) { delete Get(s); }
+            static void Copy(Storage &dst, const Storage &src) { Create(dst, *Get(const_cast<Storage &>(src))); }
+            static void Move(Storage &dst, Storage &src) { dst.ptr = src.ptr; }
+            static const Ops ops;
         };
-        holder *_content;
+
+        template <class T>
+        static const Ops *OpsOf() { return &Manager<T>::ops; }
+
+        template <class T>
+        using Decay = typename std::decay<T>::type;
+
+        const Ops *_ops; // 为nullptr时表示没有保存数据
+        Storage _storage;
 
     public:
-        Any() : _content(nullptr) {}
+        BasicAny() : _ops(nullptr) {}
+
+        template <class T, class D = Decay<T>, class = typename std::enable_if<!std::is_same<D, BasicAny>::value>::type>
+        BasicAny(T &&val) : _ops(nullptr)
+        {
+            emplace<D>(std::forward<T>(val));
+        }
+        BasicAny(const BasicAny &other) : _ops(nullptr)
+        {
+            if (other._ops)
+            {
+                other._ops->copy(_storage, other._storage);
+                _ops = other._ops;
+            }
+        }
+        BasicAny(BasicAny &&other) noexcept : _ops(nullptr)
+        {
+            if (other._ops)
+            {
+                other._ops->move(_storage, other._storage);
+                _ops = other._ops;
+                other._ops = nullptr;
+            }
+        }
+        ~BasicAny() { reset(); }
+
+        // 原地构造T，不产生临时对象
+        template <class T, class... Args>
+        T *emplace(Args &&...args)
+        {
+            reset();
+            Manager<T>::Create(_storage, std::forward<Args>(args)...);
+            _ops = OpsOf<T>();
+            return Manager<T>::Get(_storage);
+        }
+
+        void reset()
+        {
+            if (_ops)
+            {
+                _ops->destroy(_storage);
+                _ops = nullptr;
+            }
+        }
+
+        bool empty() const { return _ops == nullptr; }
 
         template <class T>
-        Any(const T &val) : _content(new placeholder<T>(val)) {}
-        Any(const Any &other) : _content(other._content ? other._content->clone() : nullptr) {}
-        ~Any() { delete _content; }
+        bool is() const { return _ops == OpsOf<T>(); }
 
-        Any &swap(Any &other)
+        BasicAny &swap(BasicAny &other)
         {
-            std::swap(_content, other._content);
+            BasicAny tmp(std::move(other));
+            other = std::move(*this);
+            *this = std::move(tmp);
             return *this;
         }
 
-        // 返回子类对象保存的数据指针
+        // 返回保存的数据指针
         template <class T>
         T *get()
         {
             // 想要获取的数据类型，必须和我们保存的数据类型一致
-            assert(typeid(T) == _content->type());
+            assert(is<T>());
 
-            return &((placeholder<T> *)_content)->_val;
+            return Manager<T>::Get(_storage);
         }
 
         // 赋值运算符的重载函数
-        template <class T>
-        Any &operator=(const T &val)
+        template <class T, class D = Decay<T>, class = typename std::enable_if<!std::is_same<D, BasicAny>::value>::type>
+        BasicAny &operator=(T &&val)
         {
-            // 为 val 构造一个临时的通用容器，然后与当前容器自身进行指针交换，临时对象释放的时候，原先保存的数据也就被释放了
-            Any(val).swap(*this);
+            // val可能引用当前保存的数据，先构造再替换
+            *this = BasicAny(std::forward<T>(val));
             return *this;
         }
 
-        Any &operator=(const Any &other)
+        BasicAny &operator=(const BasicAny &other)
         {
-            Any(other).swap(*this);
+            if (this != &other)
+                BasicAny(other).swap(*this);
             return *this;
         }
+
+        BasicAny &operator=(BasicAny &&other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                if (other._ops)
+                {
+                    other._ops->move(_storage, other._storage);
+                    _ops = other._ops;
+                    other._ops = nullptr;
+                }
+            }
+            return *this;
+        }
+
+    private:
+        template <class T>
+        static constexpr typename std::enable_if<std::is_copy_constructible<T>::value, void (*)(Storage &, const Storage &)>::type CopyOf()
+        {
+            return &Manager<T>::Copy;
+        }
+        template <class T>
+        static constexpr typename std::enable_if<!std::is_copy_constructible<T>::value, void (*)(Storage &, const Storage &)>::type CopyOf()
+        {
+            return &CopyFail;
+        }
+        // 保存的类型只能移动，拷贝BasicAny属于使用错误，类型在运行时才知道，无法在编译期拒绝，
+        // 直接终止进程，不依赖assert（NDEBUG下同样生效）
+        static void CopyFail(Storage &, const Storage &)
+        {
+            fprintf(stderr, "BasicAny: copy of a move-only value\n");
+            abort();
+        }
     };
-}
\ No newline at end of file
+
+    template <size_t Size>
+    template <class T, bool Inline>
+    const typename BasicAny<Size>::Ops BasicAny<Size>::Manager<T, Inline>::ops = {
+        &BasicAny<Size>::Manager<T, Inline>::Destroy, BasicAny<Size>::template CopyOf<T>(), &BasicAny<Size>::Manager<T, Inline>::Move};
+
+    template <size_t Size>
+    template <class T>
+    const typename BasicAny<Size>::Ops BasicAny<Size>::Manager<T, false>::ops = {
+        &BasicAny<Size>::Manager<T, false>::Destroy, BasicAny<Size>::template CopyOf<T>(), &BasicAny<Size>::Manager<T, false>::Move};
+
+    typedef BasicAny<ANY_INLINE_SIZE> Any;
+}
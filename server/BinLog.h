@@ -0,0 +1,533 @@
+#pragma once
+
+#include "Log.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <pthread.h>
+
+namespace my_muduo
+{
+#define BINLOG_RING_SIZE (1 << 20)  // 每个线程环形缓冲区的大小，必须是2的幂
+#define BINLOG_STR_MAX 256          // 单个字符串参数最多记录的字节数
+#define BINLOG_POLL_INTERVAL 1      // 后台线程没有日志可处理时的休眠时间(ms)
+#define BINLOG_PAD_SITE 0xffffffffu // 环形缓冲区末尾的填充记录
+
+    // 参数类型标记，后台线程按标记还原参数
+    typedef enum
+    {
+        BINLOG_ARG_INT,
+        BINLOG_ARG_UINT,
+        BINLOG_ARG_DOUBLE,
+        BINLOG_ARG_PTR,
+        BINLOG_ARG_STR,
+    } BINLOG_ARG_T;
+
+    // 日志调用点：格式串、源文件等只在第一次执行时注册一次，之后只记录调用点编号
+    struct BinLogSite
+    {
+        int level;
+        const char *prefix; // 颜色和级别字母
+        const char *format;
+        const char *file;
+        int line;
+    };
+
+    // 记录头，之后紧跟编码后的参数，整条记录按8字节对齐
+    struct BinLogHeader
+    {
+        uint32_t size;
+        uint32_t site;
+        uint64_t time_ns;
+        uint64_t thread;
+    };
+
+    // 单生产者单消费者的无锁环形缓冲区，写日志的线程只写_head，后台线程只写_tail
+    class BinLogRing
+    {
+    private:
+        char *_data;
+        std::atomic<uint64_t> _head;    // 生产者已经提交的位置
+        std::atomic<uint64_t> _tail;    // 消费者已经处理完的位置
+        std::atomic<uint64_t> _dropped; // 缓冲区已满时丢弃的记录数
+
+    public:
+        BinLogRing() : _data(new char[BINLOG_RING_SIZE]), _head(0), _tail(0), _dropped(0) {}
+        ~BinLogRing() { delete[] _data; }
+
+        // 申请size字节（已对齐）的连续空间，空间不足返回nullptr；末尾剩余空间不够时先写入填充记录
+        char *Reserve(uint32_t size)
+        {
+            uint64_t head = _head.load(std::memory_order_relaxed);
+            uint64_t tail = _tail.load(std::memory_order_acquire);
+            uint32_t offset = head & (BINLOG_RING_SIZE - 1);
+            uint32_t pad = offset + size > BINLOG_RING_SIZE ? BINLOG_RING_SIZE - offset : 0;
+            if (head + pad + size - tail > BINLOG_RING_SIZE)
+            {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            if (pad > 0)
+            {
+                BinLogHeader *marker = (BinLogHeader *)(_data + offset);
+                marker->size = pad;
+                marker->site = BINLOG_PAD_SITE;
+                _head.store(head + pad, std::memory_order_release);
+                offset = 0;
+            }
+            return _data + offset;
+        }
+        void Commit(uint32_t size) { _head.store(_head.load(std::memory_order_relaxed) + size, std::memory_order_release); }
+
+        // 以下由后台线程调用
+        uint64_t Head() { return _head.load(std::memory_order_acquire); }
+        uint64_t Tail() { return _tail.load(std::memory_order_relaxed); }
+        const char *At(uint64_t pos) { return _data + (pos & (BINLOG_RING_SIZE - 1)); }
+        void Release(uint64_t pos) { _tail.store(pos, std::memory_order_release); }
+        uint64_t TakeDropped() { return _dropped.exchange(0, std::memory_order_relaxed); }
+    };
+
+    /* 二进制延迟格式化日志：
+     * 写日志的线程只把调用点编号、时间戳和参数的原始字节拷贝到本线程的环形缓冲区中，
+     * 由后台线程按注册的格式串还原成文本，再交给Log输出（屏幕或者异步文件）。
+     * 格式串只支持printf的常用转换(d i u x X o c f e g a p s)，不支持 * 宽度和 %n。 */
+    class BinLog
+    {
+    public:
+        BinLog() : _running(false), _cached_sec(-1) {}
+        ~BinLog() { Stop(); }
+
+        /**
+         * @brief 注册日志调用点，由 BLOGx 宏在每个调用点第一次执行时调用
+         * @param level[in] 日志级别
+         * @param prefix[in] 颜色和级别字母
+         * @param format[in] 格式串，必须是字符串常量
+         * @param file[in] 源文件
+         * @param line[in] 行号
+         * @return 调用点编号
+         */
+        uint32_t Register(int level, const char *prefix, const char *format, const char *file, int line)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _sites.push_back(BinLogSite{level, prefix, format, file, line});
+            return _sites.size() - 1;
+        }
+
+        template <typename... Args>
+        void Write(uint32_t site, const Args &...args)
+        {
+            uint32_t size = Align(sizeof(BinLogHeader) + ArgsSize(args...));
+            BinLogRing *ring = ThreadRing();
+            char *record = ring->Reserve(size);
+            if (record == nullptr)
+                return;
+            BinLogHeader *header = (BinLogHeader *)record;
+            header->size = size;
+            header->site = site;
+            header->time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::system_clock::now().time_since_epoch())
+                                  .count();
+            header->thread = (uint64_t)pthread_self();
+            EncodeArgs(record + sizeof(BinLogHeader), args...);
+            ring->Commit(size);
+        }
+
+        // 等待后台线程处理完所有已经提交的日志后退出
+        void Stop()
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_running == false)
+                    return;
+                _running = false;
+            }
+            _consumer.join();
+        }
+
+    private:
+        static uint32_t Align(size_t size) { return (size + 7) & ~(size_t)7; }
+
+        // ----------------------------- 参数编码 -----------------------------
+        static size_t ArgsSize() { return 0; }
+        template <typename T, typename... Rest>
+        static size_t ArgsSize(const T &arg, const Rest &...rest) { return ArgSize(arg) + ArgsSize(rest...); }
+
+        template <typename T>
+        static size_t ArgSize(const T &) { return 1 + 8; }
+        static size_t ArgSize(const char *str) { return 1 + 2 + StrLen(str); }
+        static size_t ArgSize(char *str) { return ArgSize((const char *)str); }
+        static size_t StrLen(const char *str)
+        {
+            if (str == nullptr)
+                return 6; // "(null)"
+            size_t len = 0;
+            while (len < BINLOG_STR_MAX && str[len] != '\0')
+                len++;
+            return len;
+        }
+
+        static void EncodeArgs(char *) {}
+        template <typename T, typename... Rest>
+        static void EncodeArgs(char *p, const T &arg, const Rest &...rest)
+        {
+            p = Encode(p, arg);
+            EncodeArgs(p, rest...);
+        }
+
+        static char *EncodeWord(char *p, BINLOG_ARG_T type, const void *value)
+        {
+            *p = type;
+            memcpy(p + 1, value, 8);
+            return p + 9;
+        }
+        template <typename T>
+        static char *Encode(char *p, const T &arg, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type * = nullptr)
+        {
+            if (std::is_signed<T>::value)
+            {
+                int64_t value = (int64_t)arg;
+                return EncodeWord(p, BINLOG_ARG_INT, &value);
+            }
+            uint64_t value = (uint64_t)arg;
+            return EncodeWord(p, BINLOG_ARG_UINT, &value);
+        }
+        template <typename T>
+        static char *Encode(char *p, const T &arg, typename std::enable_if<std::is_floating_point<T>::value>::type * = nullptr)
+        {
+            double value = arg;
+            return EncodeWord(p, BINLOG_ARG_DOUBLE, &value);
+        }
+        template <typename T>
+        static char *Encode(char *p, T *const &arg)
+        {
+            uint64_t value = (uint64_t)(uintptr_t)arg;
+            return EncodeWord(p, BINLOG_ARG_PTR, &value);
+        }
+        static char *EncodeStr(char *p, const char *str, size_t len)
+        {
+            uint16_t len16 = len;
+            *p = BINLOG_ARG_STR;
+            memcpy(p + 1, &len16, 2);
+            memcpy(p + 3, str, len);
+            return p + 3 + len;
+        }
+        static char *Encode(char *p, const char *const &str) { return EncodeStr(p, str ? str : "(null)", StrLen(str)); }
+        static char *Encode(char *p, char *const &str) { return Encode(p, (const char *const &)str); }
+        template <size_t N>
+        static char *Encode(char *p, const char (&str)[N]) { return Encode(p, (const char *)str); }
+        template <size_t N>
+        static size_t ArgSize(const char (&str)[N]) { return ArgSize((const char *)str); }
+
+        // ----------------------------- 后台还原 -----------------------------
+        BinLogRing *ThreadRing()
+        {
+            // 线程退出后缓冲区仍由_rings持有，后台线程处理完剩余的日志后再释放
+            thread_local std::shared_ptr<BinLogRing> ring;
+            if (!ring)
+            {
+                ring = std::make_shared<BinLogRing>();
+                std::unique_lock<std::mutex> lock(_mutex);
+                _rings.push_back(ring);
+                if (_running == false)
+                {
+                    _running = true;
+                    _consumer = std::thread(&BinLog::ConsumerEntry, this);
+                }
+            }
+            return ring.get();
+        }
+
+        void ConsumerEntry()
+        {
+            std::string text;
+            bool running = true;
+            while (running)
+            {
+                std::vector<std::shared_ptr<BinLogRing>> rings;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    running = _running;
+                    rings = _rings;
+                }
+                size_t consumed = 0;
+                for (auto &ring : rings)
+                    consumed += Drain(ring.get(), text);
+                if (consumed == 0 && running)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(BINLOG_POLL_INTERVAL));
+                Cleanup();
+            }
+        }
+
+        // 处理一个环形缓冲区中已经提交的全部记录，返回处理的记录数
+        size_t Drain(BinLogRing *ring, std::string &text)
+        {
+            uint64_t dropped = ring->TakeDropped();
+            if (dropped > 0)
+            {
+                char notice[128];
+                int len = snprintf(notice, sizeof(notice), "binlog ring full, %lu records dropped\n", dropped);
+                lg.Flushlog(notice, len);
+            }
+            uint64_t head = ring->Head();
+            uint64_t pos = ring->Tail();
+            size_t count = 0;
+            while (pos < head)
+            {
+                const BinLogHeader *header = (const BinLogHeader *)ring->At(pos);
+                if (header->site != BINLOG_PAD_SITE && header->site >= _site_cache.size())
+                {
+                    // 调用点只增不减，遇到新注册的调用点时才重新拷贝
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _site_cache = _sites;
+                }
+                if (header->site != BINLOG_PAD_SITE && header->site < _site_cache.size())
+                {
+                    Format(_site_cache[header->site], header, (const char *)(header + 1), text);
+                    count++;
+                }
+                pos += header->size;
+                // 攒够一批再交给Log，减少加锁次数
+                if (text.size() >= LOG_BUFFER_SIZE / 2)
+                {
+                    lg.Flushlog(text.data(), text.size());
+                    text.clear();
+                }
+            }
+            ring->Release(pos);
+            if (text.empty() == false)
+            {
+                lg.Flushlog(text.data(), text.size());
+                text.clear();
+            }
+            return count;
+        }
+
+        // 按格式串依次还原参数，格式与LOG_FORMAT输出的文本日志一致
+        void Format(const BinLogSite &site, const BinLogHeader *header, const char *args, std::string &text)
+        {
+            char buf[BINLOG_STR_MAX + 64];
+            time_t sec = header->time_ns / 1000000000;
+            if (sec != _cached_sec)
+            {
+                struct tm tm_time;
+                localtime_r(&sec, &tm_time);
+                snprintf(_cached_time, sizeof(_cached_time), "%02d:%02d:%02d", tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec);
+                _cached_sec = sec;
+            }
+            text.append(site.prefix);
+            text.append(" [");
+            text.append(_cached_time);
+            text.append("][");
+            text.append(site.file);
+            text.append("](");
+            AppendInt(text, site.line, false);
+            text.append(")(0x");
+            AppendHex(text, header->thread);
+            text.append("): ");
+            const char *end = (const char *)header + header->size;
+            const char *fmt = site.format;
+            while (*fmt != '\0')
+            {
+                if (*fmt != '%')
+                {
+                    const char *next = strchr(fmt, '%');
+                    size_t n = next ? next - fmt : strlen(fmt);
+                    text.append(fmt, n);
+                    fmt += n;
+                    continue;
+                }
+                if (fmt[1] == '%')
+                {
+                    text.push_back('%');
+                    fmt += 2;
+                    continue;
+                }
+                // 拷贝标志、宽度和精度，去掉长度修饰符，转换字符按参数的实际类型选择
+                char spec[32] = "%";
+                size_t spec_len = 1;
+                fmt++;
+                while (*fmt != '\0' && strchr("-+ #0123456789.", *fmt) && spec_len < sizeof(spec) - 4)
+                    spec[spec_len++] = *fmt++;
+                while (*fmt != '\0' && strchr("hlLqjzt", *fmt))
+                    fmt++;
+                char conv = *fmt;
+                if (conv != '\0')
+                    fmt++;
+                if (args >= end || conv == '\0')
+                    break;
+                args = FormatArg(spec, spec_len, conv, args, buf, sizeof(buf), text);
+            }
+            text.append(LOG_RESET_COLOR "\n");
+        }
+
+        static const char *FormatArg(char *spec, size_t spec_len, char conv, const char *arg, char *buf, size_t buf_size, std::string &text)
+        {
+            int len = 0;
+            uint8_t type = *arg;
+            if (type == BINLOG_ARG_STR)
+            {
+                uint16_t str_len;
+                memcpy(&str_len, arg + 1, 2);
+                if (spec_len == 1)
+                {
+                    text.append(arg + 3, str_len);
+                    return arg + 3 + str_len;
+                }
+                // 带宽度等标志时拷贝出以'\0'结尾的字符串再交给snprintf
+                char str[BINLOG_STR_MAX + 1];
+                memcpy(str, arg + 3, str_len);
+                str[str_len] = '\0';
+                spec[spec_len++] = 's';
+                spec[spec_len] = '\0';
+                len = snprintf(buf, buf_size, spec, str);
+                if (len > 0)
+                    text.append(buf, len < (int)buf_size ? len : buf_size - 1);
+                return arg + 3 + str_len;
+            }
+            uint64_t word;
+            memcpy(&word, arg + 1, 8);
+            // 没有标志和宽度的整数直接转换，不经过snprintf
+            if (spec_len == 1 && (type == BINLOG_ARG_INT || type == BINLOG_ARG_UINT) && (conv == 'd' || conv == 'i' || conv == 'u'))
+            {
+                AppendInt(text, word, type == BINLOG_ARG_INT);
+                return arg + 9;
+            }
+            switch (type)
+            {
+            case BINLOG_ARG_DOUBLE:
+            {
+                double value;
+                memcpy(&value, &word, 8);
+                spec[spec_len++] = strchr("feEgGaA", conv) ? conv : 'g';
+                spec[spec_len] = '\0';
+                len = snprintf(buf, buf_size, spec, value);
+                break;
+            }
+            case BINLOG_ARG_PTR:
+                spec[spec_len++] = 'p';
+                spec[spec_len] = '\0';
+                len = snprintf(buf, buf_size, spec, (void *)(uintptr_t)word);
+                break;
+            default:
+                if (conv == 'c')
+                {
+                    spec[spec_len++] = 'c';
+                    spec[spec_len] = '\0';
+                    len = snprintf(buf, buf_size, spec, (int)word);
+                    break;
+                }
+                spec[spec_len++] = 'l';
+                spec[spec_len++] = 'l';
+                if (strchr("uxXo", conv))
+                    spec[spec_len++] = conv;
+                else
+                    spec[spec_len++] = type == BINLOG_ARG_INT ? 'd' : 'u';
+                spec[spec_len] = '\0';
+                len = snprintf(buf, buf_size, spec, (long long)word);
+                break;
+            }
+            if (len > 0)
+                text.append(buf, len < (int)buf_size ? len : buf_size - 1);
+            return arg + 9;
+        }
+
+        static void AppendInt(std::string &text, uint64_t value, bool is_signed)
+        {
+            char digits[24];
+            int n = 0;
+            bool negative = is_signed && (int64_t)value < 0;
+            if (negative)
+                value = 0 - value;
+            do
+            {
+                digits[n++] = '0' + value % 10;
+                value /= 10;
+            } while (value > 0);
+            if (negative)
+                text.push_back('-');
+            while (n > 0)
+                text.push_back(digits[--n]);
+        }
+
+        static void AppendHex(std::string &text, uint64_t value)
+        {
+            char digits[16];
+            int n = 0;
+            do
+            {
+                digits[n++] = "0123456789abcdef"[value & 0xf];
+                value >>= 4;
+            } while (value > 0);
+            while (n > 0)
+                text.push_back(digits[--n]);
+        }
+
+        // 清理已经退出并且处理完的线程的缓冲区
+        void Cleanup()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            for (size_t i = 0; i < _rings.size();)
+            {
+                if (_rings[i].use_count() == 1 && _rings[i]->Head() == _rings[i]->Tail())
+                {
+                    _rings[i] = _rings.back();
+                    _rings.pop_back();
+                    continue;
+                }
+                i++;
+            }
+        }
+
+    private:
+        std::mutex _mutex;                                 // 保护以下注册信息
+        bool _running;                                     // 后台线程是否在运行
+        std::thread _consumer;                             // 后台还原线程
+        std::vector<BinLogSite> _sites;                    // 所有调用点
+        std::vector<std::shared_ptr<BinLogRing>> _rings;   // 所有线程的环形缓冲区
+        std::vector<BinLogSite> _site_cache;               // 后台线程使用的调用点副本
+        time_t _cached_sec;                                // 后台线程缓存的时间戳
+        char _cached_time[16];
+    };
+
+    BinLog binlg;
+
+    // 只用于让编译器检查格式串与参数是否匹配，不会被调用
+    static inline void BinLogCheckFormat(const char *, ...) __attribute__((format(printf, 1, 2)));
+    static inline void BinLogCheckFormat(const char *, ...) {}
+
+#define BLOG_LEVEL(level, letter, format, ...) do {                                  \
+        if (lg.Level() >= level) {                                                  \
+            if (false) BinLogCheckFormat(format, ##__VA_ARGS__);                    \
+            static const uint32_t blog_site = binlg.Register(level, LOG_COLOR_ ##letter #letter, \
+                                                             format, LogSourceName(__FILE__), __LINE__); \
+            binlg.Write(blog_site, ##__VA_ARGS__);                                   \
+        }                                                                           \
+    } while(0)
+
+#define BLOGE(format, ...) BLOG_LEVEL(LOG_ERROR, E, format, ##__VA_ARGS__)
+
+#if LOG_COMPILE_LEVEL < 1
+#define BLOGW LOG_DISABLED
+#else
+#define BLOGW(format, ...) BLOG_LEVEL(LOG_WARN , W, format, ##__VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL < 2
+#define BLOGI LOG_DISABLED
+#else
+#define BLOGI(format, ...) BLOG_LEVEL(LOG_INFO , I, format, ##__VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL < 3
+#define BLOGD LOG_DISABLED
+#else
+#define BLOGD(format, ...) BLOG_LEVEL(LOG_DEBUG, D, format, ##__VA_ARGS__)
+#endif
+}
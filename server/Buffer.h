@@ -64,7 +64,6 @@ namespace my_muduo
             else
             {
                 // 总体空间不够，则需要扩容，不移动数据，直接给写偏移之后扩容足够空间即可
-                LOGD("RESIZE %ld", _writer_idx + len);
                 _buffer.resize(_writer_idx + len);
             }
         }
@@ -27,6 +27,8 @@ namespace my_muduo
         }
         Channel(EventLoop *loop, int fd) : _fd(fd), _events(0), _revents(0), _loop(loop) {}
         int Fd() { return _fd; }
+        /* 修改所属的EventLoop，必须在移除监控之后、重新添加监控之前调用（连接迁移） */
+        void SetLoop(EventLoop *loop) { _loop = loop; }
         /* 获取想要监控的事件 */
         uint32_t Events() { return _events; }
         void SetREvents(uint32_t events) { _revents = events; }
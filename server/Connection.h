@@ -6,9 +6,27 @@
 #include "Any.h"
 #include "EventLoop.h"
 #include <memory>
+#include <atomic>
+#include <deque>
 
 namespace my_muduo
 {
+#define CONTEXT_INLINE_SIZE 2048 // 连接上下文的内联存储大小，能放下HTTPContext，建立连接时不需要为上下文额外分配
+#define CONN_IOV_MAX 16          // 一次sendmsg最多发送的数据块个数
+#define CONN_SPLICE_MAX 65536    // 一次splice最多转存的数据长度，不超过管道的默认容量
+
+    typedef BasicAny<CONTEXT_INLINE_SIZE> ConnContext;
+
+    // 排在输出缓冲区之后待发送的一块数据：内存数据或者文件中的一段
+    struct OutChunk
+    {
+        std::shared_ptr<const std::string> data; // 内存数据，为空时表示文件数据
+        std::shared_ptr<const void> owner;       // 文件描述符的所有者，发送完成之前保证描述符不被关闭
+        int fd;
+        off_t offset; // 内存数据或文件中下一个待发送的位置
+        size_t len;   // 剩余待发送的长度
+    };
+
     typedef enum
     {
         DISCONNECTED, /* 连接关闭状态 */
@@ -17,8 +35,6 @@ namespace my_muduo
         DISCONNECTING /* 待关闭状态 */
     } ConnStatu;
 
-    class Connection;
-    using PtrConnection = std::shared_ptr<Connection>;
     // enable_shared_from_this 当前对象创建时内部会创建一个weak_ptr
     class Connection : public std::enable_shared_from_this<Connection>
     {
@@ -27,13 +43,25 @@ namespace my_muduo
         // uint64_t _timer_id          // 定时器ID，必须是唯一的，_conn_id作为定时器id
         int _sockfd;                   // 连接关联的文件描述符
         bool _enable_inactive_release; // 连接是否启动非活跃销毁的判断标志，默认为false
-        EventLoop *_loop;              // 连接所关联的EventLoop
+        std::atomic<EventLoop *> _loop; // 连接所关联的EventLoop，迁移时会被修改，其他线程可能同时读取
+        std::atomic<bool> _migrating;   // 连接是否正在迁移到新的loop
+        std::mutex _task_mutex;         // 保护迁移标志的切换和迁移期间暂存的任务
+        std::vector<std::function<void()>> _migrate_tasks; // 迁移期间投递的任务，新loop接管之后按投递顺序执行
+        int _inactive_sec;              // 非活跃销毁的超时时间，迁移时在新loop上重新添加定时任务
+        uint64_t _event_count;          // 触发的事件次数，用于统计连接的负载
         ConnStatu _statu;              // 链接状态
         Sock _socket;                  // 套接字操作管理
         Channel _channel;              // 连接的事件管理
         Buffer _in_buffer;             // 输入缓冲区 ——— 存放从socket中读取到的数据
         Buffer _out_buffer;            // 输出缓冲区 ——— 存放要发送给对端的数据
-        Any _context;
+        std::deque<OutChunk> _out_chunks; // 排在输出缓冲区之后的大块数据和文件，移动或共享进来，不再拷贝
+        size_t _chunk_bytes;              // _out_chunks中待发送的数据总量
+        size_t _drain_mark;               // 待发送数据降到这个量以下时调用_drain_callback
+        int _splice_fd;                   // 接收的数据直接转存到这个描述符，为-1时正常读取到输入缓冲区
+        int _splice_pipe[2];              // 转存时使用的管道
+        size_t _splice_left;              // 还需要转存的数据长度
+        size_t _splice_done;              // 已经转存的数据长度
+        ConnContext _context;
 
         /* 这4个回调函数，由用户来设置 */
         /* 换句话说，这几个回调都是组件使用者使用的 */
@@ -41,6 +69,7 @@ namespace my_muduo
         using MessageCallBack = std::function<void(const PtrConnection &, Buffer *)>;
         using ClosedCallBack = std::function<void(const PtrConnection &)>;
         using AnyEventCallBack = std::function<void(const PtrConnection &)>;
+        using Functor = std::function<void()>;
         ConnectedCallBack _connected_callback;
         MessageCallBack _message_callback;
         ClosedCallBack _closed_callback;
@@ -48,12 +77,17 @@ namespace my_muduo
         /* 组件内的连接关闭回调 -- 组件内设置的，因为服务器组件内所以的连接管理起来，一旦某个连接要关
         闭，就应该从管理的地方移除掉中自己的信息*/
         ClosedCallBack _server_closed_callback;
+        Functor _drain_callback; // 一次性的发送完成通知，用于生产者的流量控制
+        using SpliceCallBack = std::function<void(const PtrConnection &, size_t, bool)>;
+        SpliceCallBack _splice_callback; // 转存结束的通知，参数为转存的长度和是否成功
 
     private:
         /* 五个最重要的接口 channel事件回调函数 */
         // 描述符触发可读事件后调用的函数，接收socket数据放到接收缓冲区中，调用_message_callback
         void HandleRead()
         {
+            if (_splice_fd >= 0)
+                return HandleSplice();
             // 1. 读取socket数据，放到缓冲区
             char buffer[65536];
             ssize_t ret = _socket.NonBlockRecv(buffer, 65535);
@@ -70,21 +104,117 @@ namespace my_muduo
                 return _message_callback(shared_from_this(), &_in_buffer);
         }
 
+        // 转存期间的可读事件：套接字中的数据经过管道直接移动到目标描述符，不拷贝到用户空间
+        void HandleSplice()
+        {
+            ssize_t ret = _socket.NonBlockSplice(_splice_pipe[1], std::min<size_t>(_splice_left, CONN_SPLICE_MAX));
+            if (ret < 0)
+                return ShutDownInLoop();
+            if (ret == 0)
+                return;
+            for (ssize_t moved = 0; moved < ret;)
+            {
+                ssize_t n = splice(_splice_pipe[0], NULL, _splice_fd, NULL, ret - moved, SPLICE_F_MOVE);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                {
+                    LOGE("splice to fd %d failed!", _splice_fd);
+                    return FinishSplice(false);
+                }
+                moved += n;
+            }
+            _splice_left -= ret;
+            _splice_done += ret;
+            if (_splice_left == 0)
+                FinishSplice(true);
+        }
+        // 转存结束：关闭管道，通知上层，然后恢复正常读取并处理输入缓冲区
+        void FinishSplice(bool ok)
+        {
+            ClosePipe();
+            _splice_fd = -1;
+            size_t done = _splice_done;
+            SpliceCallBack cb;
+            cb.swap(_splice_callback);
+            if (cb)
+                cb(shared_from_this(), done, ok);
+            ProcessInputInLoop();
+        }
+        void ClosePipe()
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                if (_splice_pipe[i] >= 0)
+                    close(_splice_pipe[i]);
+                _splice_pipe[i] = -1;
+            }
+        }
+
+        // 一直发送到没有数据或者套接字发送缓冲区写满为止，发送出错返回false
+        bool WriteOutput()
+        {
+            while (OutPending())
+            {
+                ssize_t ret;
+                size_t want;
+                if (_out_buffer.ReadAbleSize() == 0 && _out_chunks.front().data == nullptr)
+                {
+                    // 文件数据由内核直接发送
+                    OutChunk &chunk = _out_chunks.front();
+                    want = chunk.len;
+                    ret = _socket.NonBlockSendFile(chunk.fd, &chunk.offset, chunk.len);
+                    if (ret > 0)
+                    {
+                        chunk.len -= ret;
+                        _chunk_bytes -= ret;
+                        if (chunk.len == 0)
+                            _out_chunks.pop_front();
+                    }
+                }
+                else
+                {
+                    // 输出缓冲区和后面连续的内存数据块一起发送，减少系统调用
+                    struct iovec iov[CONN_IOV_MAX];
+                    int cnt = 0;
+                    want = 0;
+                    if (_out_buffer.ReadAbleSize() > 0)
+                    {
+                        iov[cnt].iov_base = _out_buffer.ReadPosition();
+                        iov[cnt].iov_len = _out_buffer.ReadAbleSize();
+                        want += iov[cnt++].iov_len;
+                    }
+                    for (size_t i = 0; i < _out_chunks.size() && _out_chunks[i].data && cnt < CONN_IOV_MAX; i++)
+                    {
+                        iov[cnt].iov_base = const_cast<char *>(_out_chunks[i].data->data() + _out_chunks[i].offset);
+                        iov[cnt].iov_len = _out_chunks[i].len;
+                        want += iov[cnt++].iov_len;
+                    }
+                    ret = _socket.NonBlockSendV(iov, cnt);
+                    if (ret > 0)
+                        ConsumeOutput(ret);
+                }
+                if (ret < 0)
+                    return false;
+                if ((size_t)ret < want)
+                    break; // 发送缓冲区满了，等下次可写事件
+            }
+            return true;
+        }
+
         // 描述符触发可写事件后调用的函数，将缓冲区数据发送
         void HandleWrite()
         {
-            // _out_buffer中保存的数据就是要发送的数据
-            ssize_t ret = _socket.NonBlockSend(_out_buffer.ReadPosition(), _out_buffer.ReadAbleSize());
-            if (ret < 0)
+            if (WriteOutput() == false)
             {
                 // 发送错误就该关闭连接了
                 if (_in_buffer.ReadAbleSize() > 0)
                     _message_callback(shared_from_this(), &_in_buffer);
                 return Release(); // 实际的关闭释放操作了
             }
-
-            _out_buffer.MoveReadOffset(ret); // 读偏移向后移动
-            if (_out_buffer.ReadAbleSize() == 0)
+            // 待发送的数据降到水位以下，通知生产者继续写入，写入的数据在下面一起判断
+            HandleDrain();
+            if (OutPending() == false)
             {
                 _channel.DisableWrite(); // 没有数据待发送了，关闭写事件监控
                 //  如果当前是连接待关闭，则有数据，发送完数据就释放连接，没有数据则直接释放
@@ -94,6 +224,42 @@ namespace my_muduo
             return;
         }
 
+        // 待发送的数据不超过水位时调用一次发送完成通知
+        void HandleDrain()
+        {
+            if (_drain_callback && OutBytesInLoop() <= _drain_mark)
+            {
+                Functor cb;
+                cb.swap(_drain_callback);
+                cb();
+            }
+        }
+
+        // 按发送的长度依次移除输出缓冲区和内存数据块中已经发送的数据
+        void ConsumeOutput(size_t sent)
+        {
+            size_t len = std::min<size_t>(sent, _out_buffer.ReadAbleSize());
+            _out_buffer.MoveReadOffset(len); // 读偏移向后移动
+            sent -= len;
+            while (sent > 0)
+            {
+                OutChunk &chunk = _out_chunks.front();
+                len = std::min(sent, chunk.len);
+                chunk.offset += len;
+                chunk.len -= len;
+                _chunk_bytes -= len;
+                sent -= len;
+                if (chunk.len == 0)
+                    _out_chunks.pop_front();
+            }
+        }
+
+        // 是否还有数据待发送
+        bool OutPending() { return _out_buffer.ReadAbleSize() > 0 || _out_chunks.empty() == false; }
+
+        // 待发送的数据总量
+        size_t OutBytesInLoop() { return _out_buffer.ReadAbleSize() + _chunk_bytes; }
+
         // 描述符触发挂断事件
         void HandleClose()
         {
@@ -115,8 +281,9 @@ namespace my_muduo
         // 2. 用户组价使用者的任意事件回调
         void HandleEvent()
         {
+            _event_count++;
             if (_enable_inactive_release == true)
-                _loop->TimerRefresh(_conn_id);
+                GetLoop()->TimerRefresh(_conn_id);
             if (_event_callback)
                 _event_callback(shared_from_this());
         }
@@ -126,7 +293,7 @@ namespace my_muduo
         {
             // 1. 修改活跃状态
             assert(_statu == CONNECTING);
-            _statu = CONNECTING;
+            _statu = CONNECTED;
             // 2. 启动读事件监控
             _channel.EnableRead();
             // 3. 调用回调函数
@@ -144,8 +311,12 @@ namespace my_muduo
             // 3. 关闭描述符
             _socket.Close();
             // 4. 如果当前定时器队列中还有定时销毁任务，则取消任务
-            if (_loop->HasTimer(_conn_id))
+            if (GetLoop()->HasTimer(_conn_id))
                 CancelInactiveReleaseInLoop();
+            _drain_callback = nullptr;
+            _splice_callback = nullptr;
+            _splice_fd = -1;
+            ClosePipe();
             // 5. 调用关闭回调函数，避免先移除服务器的连接信息被释放，然后再去处理会出错，因此先调用用户的回调函数
             if (_closed_callback)
                 _closed_callback(shared_from_this());
@@ -155,12 +326,48 @@ namespace my_muduo
                 _server_closed_callback(shared_from_this());
         }
 
+        // 把缓冲区中的数据放到发送队列的末尾
+        void AppendOutput(Buffer &buf)
+        {
+            size_t len = buf.ReadAbleSize();
+            if (len == 0)
+                return;
+            if (_out_chunks.empty() == false)
+            {
+                // 前面还有排队的数据块，为了保证顺序，作为新的数据块排在后面
+                _out_chunks.push_back(OutChunk{std::make_shared<std::string>(buf.ReadPosition(), len), nullptr, -1, 0, len});
+                _chunk_bytes += len;
+            }
+            else if (_out_buffer.ReadAbleSize() == 0)
+                std::swap(_out_buffer, buf); // 输出缓冲区为空时直接交换，不拷贝数据
+            else
+                _out_buffer.WriteBufferAndPush(buf);
+        }
+
         // 这个接口并不是实际的发送接口，只是把数据放到了发送缓冲区，启动了可写事件监控
         void SendInLoop(Buffer &buf)
         {
             if (_statu == DISCONNECTED)
                 return;
-            _out_buffer.WriteBufferAndPush(buf);
+            AppendOutput(buf);
+            if (OutPending() && _channel.WriteAble() == false)
+                _channel.EnableWrite();
+        }
+        void SendChunkInLoop(const std::shared_ptr<const std::string> &data)
+        {
+            if (_statu == DISCONNECTED || data->empty())
+                return;
+            _out_chunks.push_back(OutChunk{data, nullptr, -1, 0, data->size()});
+            _chunk_bytes += data->size();
+            if (_channel.WriteAble() == false)
+                _channel.EnableWrite();
+        }
+        void SendFileInLoop(const std::shared_ptr<const void> &owner, int fd, off_t offset, size_t len)
+        {
+            if (_statu == DISCONNECTED || len == 0)
+                return;
+            _out_chunks.push_back(OutChunk{nullptr, owner, fd, offset, len});
+            _chunk_bytes += len;
             if (_channel.WriteAble() == false)
                 _channel.EnableWrite();
         }
@@ -177,42 +384,137 @@ namespace my_muduo
             }
 
             // 要么写入数据的时候出错关闭，要么就是没有待发送的数据，直接关闭
-            if (_out_buffer.ReadAbleSize() > 0)
+            if (OutPending() == true)
             {
                 if (_channel.WriteAble() == false)
                     _channel.EnableWrite();
             }
 
-            if (_out_buffer.ReadAbleSize() == 0)
+            if (OutPending() == false)
             {
                 Release();
             }
         }
 
+        // 重新处理输入缓冲区中已经收到的数据，比如暂停处理流水线请求之后恢复
+        // 缓冲区为空时也调用，上层可以继续处理已经接收完整的请求（比如正文转存完毕）
+        void ProcessInputInLoop()
+        {
+            if (_statu == CONNECTED && _message_callback)
+                _message_callback(shared_from_this(), &_in_buffer);
+        }
+
         // 启动非活跃连接超时释放规则
         void EnableInactiveReleaseInLoop(int sec)
         {
             // 1. 将判断标志 _enable_inactive_release置为true
             _enable_inactive_release = true;
+            _inactive_sec = sec;
 
             // 2. 如果当前定时销毁任务存在，那么就刷新延迟一下即可
-            if (_loop->HasTimer(_conn_id))
-                return _loop->TimerRefresh(_conn_id);
+            if (GetLoop()->HasTimer(_conn_id))
+                return GetLoop()->TimerRefresh(_conn_id);
 
             // 3. 如果不存在定时销毁任务，则新增
-            _loop->TimerAdd(_conn_id, sec, std::bind(&Connection::Release, this));
+            GetLoop()->TimerAdd(_conn_id, sec, std::bind(&Connection::Release, this));
         }
 
         // 取消非活跃销毁
         void CancelInactiveReleaseInLoop()
         {
             _enable_inactive_release = false;
-            if (_loop->HasTimer(_conn_id))
-                return _loop->TimerCancel(_conn_id);
+            if (GetLoop()->HasTimer(_conn_id))
+                return GetLoop()->TimerCancel(_conn_id);
+        }
+
+        // 在连接所属的loop中执行任务
+        void RunInOwnerLoop(const Functor &cb)
+        {
+            if (GetLoop()->IsInLoop() && _migrating == false)
+                return cb();
+            QueueInOwnerLoop(cb);
+        }
+        // 把任务压入连接所属loop的任务池，迁移期间投递的任务按投递顺序暂存在连接中，新loop接管之后依次执行
+        // 判断迁移标志和压入任务池在同一把锁内完成，迁移开始之前投递的任务一定排在旧loop中的交接任务之前
+        void QueueInOwnerLoop(const Functor &cb)
+        {
+            std::unique_lock<std::mutex> lock(_task_mutex);
+            if (_migrating)
+                return _migrate_tasks.push_back(cb);
+            GetLoop()->QueueInLoop(std::bind(&Connection::RunOwnedTask, this, cb));
+        }
+        void RunOwnedTask(const Functor &cb)
+        {
+            if (GetLoop()->IsInLoop() == false)
+                return QueueInOwnerLoop(cb);
+            cb();
+        }
+
+        // 迁移第一步，在旧loop中执行：停止事件监控，之后投递的任务暂存在连接中
+        // 迁移开始之前已经压入旧loop任务池的任务仍然在旧loop中执行，全部执行完之后再由交接任务切换所属loop，
+        // 这样发送等任务的执行顺序和投递顺序一致，输出的数据不会乱序
+        void MigrateInLoop(EventLoop *target)
+        {
+            if (_statu != CONNECTED || _migrating || target == GetLoop())
+                return target->DecConnectionCount(); // 放弃迁移，撤销MigrateTo中计入的连接数
+            LOGD("migrate connection %lu from loop %p to %p", _conn_id, GetLoop(), target);
+            _channel.Remove();
+            std::unique_lock<std::mutex> lock(_task_mutex);
+            _migrating = true;
+            GetLoop()->QueueInLoop(std::bind(&Connection::HandOffInLoop, shared_from_this(), target));
+        }
+
+        // 迁移第二步，在旧loop中执行：移除定时任务和连接管理信息，切换所属loop，交给新loop接管
+        // 内核中未读取的数据在新loop重新监控后继续触发，不会丢失数据
+        void HandOffInLoop(EventLoop *target)
+        {
+            EventLoop *source = GetLoop();
+            if (_statu != CONNECTED)
+            {
+                // 等待期间连接已经释放，不再迁移，暂存的任务在旧loop中执行
+                target->DecConnectionCount();
+                RunMigrateTasks();
+                return;
+            }
+            // 等待期间执行的任务有可能重新添加了事件监控
+            _channel.Remove();
+            if (_enable_inactive_release)
+                source->TimerCancel(_conn_id);
+            source->RemoveConnection(_conn_id);
+            source->DecConnectionCount();
+            _channel.SetLoop(target);
+            std::unique_lock<std::mutex> lock(_task_mutex);
+            _loop = target;
+            target->QueueInLoop(std::bind(&Connection::AttachInLoop, shared_from_this()));
+        }
+
+        // 迁移第三步，在新loop中执行：重新添加连接管理信息、定时任务和事件监控，然后按顺序执行暂存的任务
+        void AttachInLoop()
+        {
+            EventLoop *loop = GetLoop();
+            loop->AddConnection(_conn_id, shared_from_this());
+            if (_enable_inactive_release)
+                loop->TimerAdd(_conn_id, _inactive_sec, std::bind(&Connection::Release, this));
+            // channel中保存的监控事件没有变化，直接重新添加到新loop的poller中
+            _channel.Update();
+            RunMigrateTasks();
+        }
+
+        // 结束迁移，在所属loop中按投递顺序执行迁移期间暂存的任务
+        void RunMigrateTasks()
+        {
+            std::vector<Functor> tasks;
+            {
+                std::unique_lock<std::mutex> lock(_task_mutex);
+                tasks.swap(_migrate_tasks);
+                _migrating = false;
+            }
+            for (auto &task : tasks)
+                task();
         }
 
         // 切换协议 -- 重置上下文和回调函数
-        void UpgradeInLoop(const Buffer &context,
+        void UpgradeInLoop(const ConnContext &context,
                            const ConnectedCallBack &conn,
                            const MessageCallBack &msg,
                            const ClosedCallBack &closed,
@@ -227,8 +529,12 @@ namespace my_muduo
 
     public:
         Connection(EventLoop *loop, uint64_t conn_id, int sockfd)
-            : _conn_id(conn_id), _sockfd(sockfd), _enable_inactive_release(false), _loop(loop), _statu(CONNECTING), _socket(_sockfd), _channel(loop, _sockfd)
+            : _conn_id(conn_id), _sockfd(sockfd), _enable_inactive_release(false), _loop(loop), _migrating(false),
+              _inactive_sec(0), _event_count(0), _statu(CONNECTING), _socket(_sockfd), _channel(loop, _sockfd),
+              _chunk_bytes(0), _drain_mark(0), _splice_fd(-1), _splice_pipe{-1, -1}, _splice_left(0), _splice_done(0)
         {
+            // 发送和接收都不能阻塞loop线程，sendfile、splice没有MSG_DONTWAIT，需要套接字本身是非阻塞的
+            _socket.NonBlock();
             _channel.SetCloseCallBack(std::bind(&Connection::HandleClose, this));
             _channel.SetEventCallBack(std::bind(&Connection::HandleEvent, this));
             _channel.SetReadCallBack(std::bind(&Connection::HandleRead, this));
@@ -242,10 +548,11 @@ namespace my_muduo
         }
 
         int Fd() { return _sockfd; }                                // 获取管理的文件描述符
-        int Id() { return _conn_id; }                               // 获取连接ID
+        uint64_t Id() { return _conn_id; }                          // 获取连接ID
+        EventLoop *GetLoop() { return _loop.load(); }               // 获取连接所关联的EventLoop
         bool Connected() { return _statu == CONNECTED; }            // 是否处于CONNECTED状态
-        void SetContext(const Any &context) { _context = context; } // 设置上下文 -- 连接建立完成时调用
-        Any *GetContext() { return &_context; }                     // 获取上下文
+        void SetContext(const ConnContext &context) { _context = context; } // 设置上下文 -- 连接建立完成时调用
+        ConnContext *GetContext() { return &_context; }                     // 获取上下文，可以用emplace原地构造
         void SetConnectionCallBack(const ConnectedCallBack &cb) { _connected_callback = cb; }
         void SetMessageCallBack(const MessageCallBack &cb) { _message_callback = cb; }
         void SetCloseCallBack(const ClosedCallBack &cb) { _closed_callback = cb; }
@@ -254,45 +561,152 @@ namespace my_muduo
         // 连接获取之后，所处的状态下要进行的各种设置（给channel设置事件回调，启动读监控）
         void Established()
         {
-            _loop->RunInLoop(std::bind(&Connection::EstablishedInLoop, this));
+            RunInOwnerLoop(std::bind(&Connection::EstablishedInLoop, this));
         }
         // 发送数据，将数据放到发送缓冲区，启动写事件监控。
         void Send(const char *data, size_t len)
         {
             Buffer buf;
             buf.WriteAndPush(data, len);
-            _loop->RunInLoop(std::bind(&Connection::SendInLoop, this, std::move(buf)));
+            RunInOwnerLoop(std::bind(&Connection::SendInLoop, this, std::move(buf)));
+        }
+        // 发送已经组织好的缓冲区，缓冲区的数据移动到连接中，调用之后buf为空
+        void Send(Buffer &&buf)
+        {
+            RunInOwnerLoop(std::bind(&Connection::SendInLoop, this, std::move(buf)));
+        }
+        // 发送大块数据，数据移动到连接中排队发送，不拷贝，调用之后data为空
+        void Send(std::string &&data)
+        {
+            std::shared_ptr<const std::string> chunk = std::make_shared<std::string>(std::move(data));
+            RunInOwnerLoop(std::bind(&Connection::SendChunkInLoop, this, chunk));
+        }
+        // 发送共享的只读数据（比如缓存的文件内容），发送完成之前一直持有引用，数据不能被修改
+        void Send(const std::shared_ptr<const std::string> &data)
+        {
+            RunInOwnerLoop(std::bind(&Connection::SendChunkInLoop, this, data));
+        }
+        // 发送文件中的一段数据，使用sendfile直接发送，owner持有描述符的所有者，发送完成之前描述符不能被关闭
+        void SendFile(const std::shared_ptr<const void> &owner, int fd, off_t offset, size_t len)
+        {
+            RunInOwnerLoop(std::bind(&Connection::SendFileInLoop, this, owner, fd, offset, len));
+        }
+
+        /**
+         * @brief 把buf中的数据放到发送队列末尾（必须在所属loop中调用），不启动写事件监控，之后需要调用Flush
+         *        一次处理中产生的多个应答先合并到同一个缓冲区，省去每次Send的任务投递和拷贝
+         * @param buf[in,out]    要发送的数据，调用之后为空，可以继续使用
+         * @return 空
+         */
+        void Append(Buffer *buf)
+        {
+            GetLoop()->AssertInLoop();
+            if (_statu != DISCONNECTED)
+                AppendOutput(*buf);
+            buf->Clear();
+        }
+        // 立即把待发送的数据写入套接字，不等待下一轮的可写事件（必须在所属loop中调用）
+        // 已经在等待可写事件时说明套接字发送缓冲区是满的，不再尝试；一次没有写完的部分启动写事件监控继续发送
+        void Flush()
+        {
+            GetLoop()->AssertInLoop();
+            if (_statu == DISCONNECTED || _channel.WriteAble() || OutPending() == false)
+                return;
+            if (WriteOutput() == false)
+                return Release();
+            if (OutPending())
+                _channel.EnableWrite();
+        }
+
+        // 待发送的数据量，包括输出缓冲区和排队的数据块、文件（必须在所属loop中调用）
+        size_t OutBytes()
+        {
+            GetLoop()->AssertInLoop();
+            return OutBytesInLoop();
+        }
+        // 待发送的数据降到mark以下时调用一次cb，已经满足时在下一轮事件循环中调用（必须在所属loop中调用）
+        // 生产者写满之后设置，数据发送出去再继续写入，内存占用不随响应大小增长；连接释放时丢弃
+        void SetDrainCallBack(size_t mark, const Functor &cb)
+        {
+            GetLoop()->AssertInLoop();
+            _drain_mark = mark;
+            _drain_callback = cb;
+            if (OutPending() == false)
+            {
+                QueueInOwnerLoop(std::bind(&Connection::HandleDrain, shared_from_this()));
+            }
+        }
+        /**
+         * @brief 接下来从套接字收到的len字节不再进入输入缓冲区，经过管道直接转存到fd（必须在所属loop中调用，输入缓冲区应该已经处理完）
+         * @param fd[in]         目标描述符，通常是打开的文件
+         * @param len[in]        转存的长度
+         * @param cb[in]         转存结束或者失败时调用，之后恢复正常读取并调用一次消息回调
+         * @return 创建管道失败时返回false
+         */
+        bool SpliceTo(int fd, size_t len, const SpliceCallBack &cb)
+        {
+            GetLoop()->AssertInLoop();
+            if (len == 0 || pipe2(_splice_pipe, O_CLOEXEC) < 0)
+                return false;
+            _splice_fd = fd;
+            _splice_left = len;
+            _splice_done = 0;
+            _splice_callback = cb;
+            return true;
+        }
+
+        // 在下一轮事件循环中重新处理输入缓冲区中已有的数据
+        void ProcessInput()
+        {
+            QueueInOwnerLoop(std::bind(&Connection::ProcessInputInLoop, shared_from_this()));
         }
 
         // 提供该组件使用者的关闭接口--实际上并不关闭，需要判断有没有事情待处理。
         void ShutDown()
         {
-            _loop->RunInLoop(std::bind(&Connection::ShutDownInLoop, this));
+            RunInOwnerLoop(std::bind(&Connection::ShutDownInLoop, this));
         }
         void Release()
         {
-            _loop->QueueInLoop(std::bind(&Connection::ReleaseInLoop, this));
+            QueueInOwnerLoop(std::bind(&Connection::ReleaseInLoop, this));
         }
         
         // 启动非活跃销毁，并定义多长时间无通信
         void EnableInactiveRelease(int sec)
         {
-            _loop->RunInLoop(std::bind(&Connection::EnableInactiveReleaseInLoop, this, sec));
+            RunInOwnerLoop(std::bind(&Connection::EnableInactiveReleaseInLoop, this, sec));
         }
 
         // 取消非活跃销毁
         void CancelInactiveRelease()
         {
-            _loop->RunInLoop(std::bind(&Connection::CancelInactiveReleaseInLoop, this));
+            RunInOwnerLoop(std::bind(&Connection::CancelInactiveReleaseInLoop, this));
+        }
+
+        // 将连接迁移到另一个loop上，可以在任意线程中调用，只有处于CONNECTED状态的连接才会迁移
+        // 和Release一样压入任务池执行，避免本轮事件处理中还有这个连接的就绪事件没有处理
+        // 调用时target必须有效：这里先把连接计入target的连接数，连接到达或者放弃迁移之前target不会因为没有连接被回收
+        void MigrateTo(EventLoop *target)
+        {
+            target->IncConnectionCount();
+            QueueInOwnerLoop(std::bind(&Connection::MigrateInLoop, shared_from_this(), target));
+        }
+
+        // 获取并清零上一次获取之后触发的事件次数（必须在所属loop中调用）
+        uint64_t TakeEventCount()
+        {
+            uint64_t count = _event_count;
+            _event_count = 0;
+            return count;
         }
 
         // 切换协议 -- 重置上下文和回调函数（线程不安全！） -- 而是在这个接口必须再EventLoop线程中立刻执行
         // 防止新的时间触发触发后，处理的时候，切换任务还没有被执行—— 会导致数据使用原协议处理了。
-        void Upgrade(const Buffer &context, const ConnectedCallBack &conn, const MessageCallBack &msg,
+        void Upgrade(const ConnContext &context, const ConnectedCallBack &conn, const MessageCallBack &msg,
                      const ClosedCallBack &closed, const AnyEventCallBack &event)
         {
-            _loop->AssertInLoop();
-            _loop->RunInLoop(std::bind(&Connection::UpgradeInLoop, this, context, conn, msg, closed, event));
+            GetLoop()->AssertInLoop();
+            GetLoop()->RunInLoop(std::bind(&Connection::UpgradeInLoop, this, context, conn, msg, closed, event));
         }
     };
 }
\ No newline at end of file
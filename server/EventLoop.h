@@ -4,10 +4,14 @@
 #include <mutex>
 #include <thread>
 #include <sys/eventfd.h>
+#include <atomic>
 #include "Timewheel.h"
 
 namespace my_muduo
 {
+    class Connection;
+    using PtrConnection = std::shared_ptr<Connection>;
+
     class EventLoop
     {
     private:
@@ -22,6 +26,21 @@ namespace my_muduo
 
         TimerWheel _timer_wheel;
 
+        std::atomic<size_t> _conn_count; // 挂在当前loop上的连接数量，供连接分配时做负载和准入判断
+
+        uint64_t _loop_id;  // loop的唯一编号，作为ID的高位，保证不同loop生成的ID不会重复
+        uint64_t _next_seq; // loop内自增的序号，作为ID的低位
+        std::unordered_map<uint64_t, PtrConnection> _conns; // 挂在当前loop上的连接，只在loop线程中访问
+
+        std::atomic<bool> _quit; // 退出事件循环的标志
+        std::atomic<uint64_t> _event_count; // 处理过的事件数量，用于统计loop的负载
+
+        static uint64_t NewLoopId()
+        {
+            static std::atomic<uint64_t> next_loop_id(0);
+            return ++next_loop_id;
+        }
+
     public:
         // 执行任务池中的所有任务
         void RunAllTask()
@@ -82,13 +101,19 @@ namespace my_muduo
     public:
         EventLoop()
             : _thread_id(std::this_thread::get_id()), _event_fd(CreateEventFd()),
-              _event_channel(new Channel(this, _event_fd)), _timer_wheel(this)
+              _event_channel(new Channel(this, _event_fd)), _timer_wheel(this), _conn_count(0),
+              _loop_id(NewLoopId()), _next_seq(0), _quit(false), _event_count(0)
         {
             // 给eventfd添加可读事件回调函数，读取eventfd时间通知次数
             _event_channel->SetReadCallBack(std::bind(&EventLoop::ReadEventFd, this));
             _event_channel->EnableRead();
         }
 
+        ~EventLoop()
+        {
+            close(_event_fd);
+        }
+
         // 判断将要执行的任务是否处于当前的线程中，如果是则执行，不是则压入队列
         void RunInLoop(const Functor &cb)
         {
@@ -129,15 +154,62 @@ namespace my_muduo
         void TimerCancel(uint64_t id) { return _timer_wheel.TimerCancel(id); }
 
         bool HasTimer(uint64_t id) { return _timer_wheel.HasTimer(id); }
+
+        // 连接计数可以在任意线程中读取
+        size_t ConnectionCount() { return _conn_count.load(std::memory_order_relaxed); }
+        void IncConnectionCount() { _conn_count.fetch_add(1, std::memory_order_relaxed); }
+        void DecConnectionCount() { _conn_count.fetch_sub(1, std::memory_order_relaxed); }
+
+        // 处理过的事件总数，可以在任意线程中读取
+        uint64_t EventCount() { return _event_count.load(std::memory_order_relaxed); }
+
+        // 生成全局唯一的ID（连接ID和定时器ID），高24位是loop编号，低40位是loop内序号，不需要跨线程同步
+        uint64_t NextId()
+        {
+            AssertInLoop();
+            return (_loop_id << 40) | (++_next_seq & 0xFFFFFFFFFFULL);
+        }
+
+        // 连接的管理，以下接口都必须在loop线程中调用
+        void AddConnection(uint64_t id, const PtrConnection &conn)
+        {
+            AssertInLoop();
+            _conns.insert(std::make_pair(id, conn));
+        }
+        void RemoveConnection(uint64_t id)
+        {
+            AssertInLoop();
+            _conns.erase(id);
+        }
+        PtrConnection FindConnection(uint64_t id)
+        {
+            AssertInLoop();
+            auto it = _conns.find(id);
+            if (it == _conns.end())
+                return PtrConnection();
+            return it->second;
+        }
+        void ForEachConnection(const std::function<void(const PtrConnection &)> &cb)
+        {
+            AssertInLoop();
+            // 回调中有可能释放连接，先拷贝一份再遍历
+            std::vector<PtrConnection> conns;
+            conns.reserve(_conns.size());
+            for (auto &it : _conns)
+                conns.push_back(it.second);
+            for (auto &conn : conns)
+                cb(conn);
+        }
         // 1. 事件监控 2. 事件处理 3. 执行任务
         void Start()
         {
-            while (1)
+            while (_quit.load() == false)
             {
                 // 1. 事件监控
                 std::vector<Channel *> actives;
                 _poller.Poll(&actives);
                 // 2. 事件处理
+                _event_count.fetch_add(actives.size(), std::memory_order_relaxed);
                 for (auto &channel : actives)
                 {
                     channel->HandlerEvent();
@@ -146,6 +218,14 @@ namespace my_muduo
                 RunAllTask();
             }
         }
+
+        // 退出事件循环，可以在任意线程中调用，当前这一轮事件和任务处理完毕后Start返回
+        void Quit()
+        {
+            _quit = true;
+            if (IsInLoop() == false)
+                WeakUpEventFd();
+        }
     };
 
     void Channel::Update() { _loop->UpdateEvent(this); }
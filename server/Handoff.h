@@ -0,0 +1,180 @@
+#pragma once
+
+#include <vector>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include "Socket.h"
+
+namespace my_muduo
+{
+#define MAX_HANDOFF_FDS 16
+
+    // 监听套接字的进程间交接：新旧进程通过Unix域套接字，使用SCM_RIGHTS传递描述符
+    // 新进程继承旧进程的监听套接字，内核全连接队列中的连接不会丢失，实现不停机重启
+    class Handoff
+    {
+    private:
+        static bool FillAddr(const std::string &path, struct sockaddr_un *addr)
+        {
+            if (path.empty() || path.size() >= sizeof(addr->sun_path))
+            {
+                LOGE("invalid handoff path: %s", path.c_str());
+                return false;
+            }
+            memset(addr, 0, sizeof(struct sockaddr_un));
+            addr->sun_family = AF_UNIX;
+            memcpy(addr->sun_path, path.c_str(), path.size());
+            return true;
+        }
+
+    public:
+        /**
+         * @brief 通过Unix域套接字发送描述符
+         * @param sockfd[in]     已连接的Unix域套接字
+         * @param fds[in]        要发送的描述符
+         * @return 是否发送成功
+         */
+        static bool SendFds(int sockfd, const std::vector<int> &fds)
+        {
+            if (fds.empty() || fds.size() > MAX_HANDOFF_FDS)
+                return false;
+            // SCM_RIGHTS 必须携带至少一个字节的普通数据
+            char data = 'F';
+            struct iovec iov;
+            iov.iov_base = &data;
+            iov.iov_len = 1;
+            char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS)];
+            memset(control, 0, sizeof(control));
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+            memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+            ssize_t ret;
+            do
+            {
+                ret = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+            } while (ret < 0 && errno == EINTR);
+            if (ret < 0)
+            {
+                LOGE("send handoff fds failed: %s", strerror(errno));
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief 通过Unix域套接字接收描述符
+         * @param sockfd[in]     已连接的Unix域套接字
+         * @param fds[out]       接收到的描述符
+         * @return 是否接收成功
+         */
+        static bool RecvFds(int sockfd, std::vector<int> *fds)
+        {
+            char data;
+            struct iovec iov;
+            iov.iov_base = &data;
+            iov.iov_len = 1;
+            char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS)];
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            ssize_t ret;
+            do
+            {
+                ret = recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC);
+            } while (ret < 0 && errno == EINTR);
+            if (ret <= 0)
+            {
+                LOGE("recv handoff fds failed: %s", ret < 0 ? strerror(errno) : "peer closed");
+                return false;
+            }
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            {
+                if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                    continue;
+                size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                const int *pfd = (const int *)CMSG_DATA(cmsg);
+                for (size_t i = 0; i < count; i++)
+                    fds->push_back(pfd[i]);
+            }
+            return fds->empty() == false;
+        }
+
+        /**
+         * @brief 创建交接用的Unix域监听套接字（非阻塞），只允许属主访问
+         * @param path[in]       套接字文件路径，已存在则先删除
+         * @return 监听套接字，失败返回-1
+         */
+        static int Listen(const std::string &path)
+        {
+            struct sockaddr_un addr;
+            if (FillAddr(path, &addr) == false)
+                return -1;
+            int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                LOGE("create handoff socket failed: %s", strerror(errno));
+                return -1;
+            }
+            unlink(path.c_str());
+            if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0)
+            {
+                LOGE("listen handoff socket %s failed: %s", path.c_str(), strerror(errno));
+                close(fd);
+                return -1;
+            }
+            chmod(path.c_str(), S_IRUSR | S_IWUSR);
+            return fd;
+        }
+
+        /**
+         * @brief 校验对端进程与当前进程属于同一个用户，避免其他用户拿走监听套接字
+         * @param sockfd[in]     已连接的Unix域套接字
+         * @return 校验结果
+         */
+        static bool CheckPeer(int sockfd)
+        {
+            struct ucred cred;
+            socklen_t len = sizeof(cred);
+            if (getsockopt(sockfd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+                return false;
+            return cred.uid == getuid();
+        }
+
+        /**
+         * @brief 从旧进程继承监听套接字
+         * @param path[in]       旧进程的交接套接字路径
+         * @return 继承到的描述符，没有旧进程在运行时返回空
+         */
+        static std::vector<int> Inherit(const std::string &path)
+        {
+            std::vector<int> fds;
+            struct sockaddr_un addr;
+            if (FillAddr(path, &addr) == false)
+                return fds;
+            int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+                return fds;
+            // 连接失败说明没有旧进程，正常创建监听套接字即可
+            if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 && CheckPeer(fd))
+            {
+                if (RecvFds(fd, &fds))
+                    LOGI("inherit %lu listen fds from %s", fds.size(), path.c_str());
+            }
+            close(fd);
+            return fds;
+        }
+    };
+}
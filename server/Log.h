@@ -8,6 +8,16 @@
 #include <fstream>
 #include <cstring>
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <condition_variable>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 namespace my_muduo
 {
@@ -19,6 +29,7 @@ namespace my_muduo
 
 #define SCREEN_TYPE 1
 #define FILE_TYPE 2
+#define IOV_MAX_COUNT 64
 
     typedef enum
     {
@@ -28,61 +39,213 @@ namespace my_muduo
         LOG_DEBUG, /*!< 普通使用不需要的额外信息(值、指针、大小等)。 */
     } LOG_LEVEL_T;
 
-    static const std::string DefaultProjectPath = "/home/user/my_muduo/My_mutuo/";
-
-    static std::string LogTimestamp()
+    // 日志时间戳，同一秒内的日志直接使用本线程缓存的格式化结果
+    static const char *LogTimestamp()
     {
+        thread_local time_t cached_sec = -1;
+        thread_local char cached[16];
         time_t now = time(nullptr);
-        struct tm *curr_time = localtime(&now);
-        char buffer[128];
-        snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d",
-                    curr_time->tm_hour, curr_time->tm_min, curr_time->tm_sec);
+        if (now != cached_sec)
+        {
+            struct tm curr_time;
+            localtime_r(&now, &curr_time);
+            snprintf(cached, sizeof(cached), "%02d:%02d:%02d",
+                     curr_time.tm_hour, curr_time.tm_min, curr_time.tm_sec);
+            cached_sec = now;
+        }
+        return cached;
+    }
 
-        return buffer;
+    // 以下函数在编译期计算日志中打印的源文件路径：
+    // 定义了LOG_SOURCE_ROOT（由CMake传入工程根目录）时打印相对工程根目录的路径，否则只打印文件名
+    constexpr const char *LogBaseName(const char *path, const char *last)
+    {
+        return *path == '\0' ? last : LogBaseName(path + 1, *path == '/' ? path + 1 : last);
     }
 
-    static const std::string GetRelativePath(const std::string &fullPath, const std::string &projectpath = DefaultProjectPath)
+    constexpr const char *LogStripPrefix(const char *path, const char *prefix, const char *origin)
     {
-        auto pos = fullPath.find(projectpath);
-        if (pos == std::string::npos)
-            return fullPath;
+        return *prefix == '\0' ? path : (*path == *prefix ? LogStripPrefix(path + 1, prefix + 1, origin) : LogBaseName(origin, origin));
+    }
 
-        return fullPath.substr(pos + projectpath.length());
+    constexpr const char *LogSourceName(const char *path)
+    {
+#ifdef LOG_SOURCE_ROOT
+        return LogStripPrefix(path, LOG_SOURCE_ROOT, path);
+#else
+        return LogBaseName(path, path);
+#endif
     }
 
     static const std::string glogfile = "../log/log.txt";
     std::mutex _mutex;
-    class Log
+
+#define LOG_BUFFER_SIZE (64 * 1024)              // 每个线程日志缓冲区的大小，写满后交给后台线程
+#define LOG_QUEUE_MAX 256                        // 等待后台线程写入的缓冲区数量上限
+#define LOG_SPARE_MAX 64                         // 缓存的空闲缓冲区数量上限，避免反复申请内存
+#define LOG_FLUSH_INTERVAL 1                     // 后台线程最长间隔多久写一次文件（秒）
+#define LOG_ROLL_SIZE (1024UL * 1024 * 1024)     // 单个日志文件的大小上限
+#define LOG_ROLL_INTERVAL (24 * 60 * 60)         // 单个日志文件的时间上限（秒）
+
+    typedef enum
     {
-    public:
-        Log(const std::string &logfile = glogfile) : _type(SCREEN_TYPE), _logfile(logfile) {}
+        LOG_DROP_NEWEST, /*!< 队列满时丢弃新写满的缓冲区 */
+        LOG_DROP_OLDEST, /*!< 队列满时丢弃最早等待写入的缓冲区 */
+    } LOG_DROP_POLICY_T;
 
-        void Enable(int type) { _type = type; }
+    // 日志文件：批量写入，按大小和时间滚动，滚动时把当前文件重命名为 文件名.年月日-时分秒
+    class LogFile
+    {
+    private:
+        std::string _filename;
+        int _fd;
+        size_t _written;      // 当前文件已经写入的大小
+        time_t _open_time;    // 当前文件的创建时间
+        size_t _roll_size;    // 文件大小上限
+        int _roll_interval;   // 文件时间上限
 
-        void FlushLogToScreen(const std::string& log)
-        {   
-            std::cout << log;
+    private:
+        void Open()
+        {
+            _fd = open(_filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+            if (_fd < 0)
+            {
+                fprintf(stderr, "open log file %s failed: %s\n", _filename.c_str(), strerror(errno));
+                return;
+            }
+            struct stat st;
+            _written = fstat(_fd, &st) == 0 ? st.st_size : 0;
+            _open_time = time(nullptr);
         }
 
-        void FlushLogToFile(const std::string& log)
+        void Roll()
         {
-            std::ofstream out(_logfile, std::ios::app);
-            if (!out.is_open())
+            close(_fd);
+            _fd = -1;
+            time_t now = time(nullptr);
+            struct tm tm_time;
+            localtime_r(&now, &tm_time);
+            char suffix[32];
+            strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &tm_time);
+            // 同一秒内多次滚动时追加序号，避免覆盖之前的文件
+            std::string target = _filename + suffix;
+            for (int i = 1; access(target.c_str(), F_OK) == 0; i++)
+                target = _filename + suffix + "." + std::to_string(i);
+            rename(_filename.c_str(), target.c_str());
+            Open();
+        }
+
+    public:
+        LogFile(const std::string &filename, size_t roll_size, int roll_interval)
+            : _filename(filename), _fd(-1), _written(0), _open_time(0), _roll_size(roll_size), _roll_interval(roll_interval)
+        {
+            Open();
+        }
+        ~LogFile()
+        {
+            if (_fd >= 0)
+                close(_fd);
+        }
+
+        // 一次系统调用写入多个缓冲区
+        void Append(std::vector<std::string> &bufs)
+        {
+            if (_fd < 0)
                 return;
-            out.write(log.c_str(), log.size());
-            out.close();
+            if (_written >= _roll_size || time(nullptr) - _open_time >= _roll_interval)
+                Roll();
+            size_t i = 0;
+            while (_fd >= 0 && i < bufs.size())
+            {
+                struct iovec iov[IOV_MAX_COUNT];
+                int count = 0;
+                for (size_t j = i; j < bufs.size() && count < IOV_MAX_COUNT; j++, count++)
+                {
+                    iov[count].iov_base = &bufs[j][0];
+                    iov[count].iov_len = bufs[j].size();
+                }
+                ssize_t ret = writev(_fd, iov, count);
+                if (ret < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    fprintf(stderr, "write log file failed: %s\n", strerror(errno));
+                    return;
+                }
+                _written += ret;
+                // 没有写完的部分（磁盘满或者被信号打断）不再重试，避免后台线程卡死在这里
+                i += count;
+            }
+        }
+    };
+
+    // 每个线程独立的日志缓冲区，写日志时只需要竞争自己的锁（只有后台线程定期收集时才会竞争）
+    struct LogThreadBuffer
+    {
+        std::mutex mutex;
+        std::string data;
+    };
+
+    class Log
+    {
+    public:
+        Log(const std::string &logfile = glogfile)
+            : _type(SCREEN_TYPE), _level(LOG_DEBUG), _logfile(logfile), _running(false), _drop_policy(LOG_DROP_OLDEST),
+              _queue_max(LOG_QUEUE_MAX), _roll_size(LOG_ROLL_SIZE), _roll_interval(LOG_ROLL_INTERVAL), _dropped(0) {}
+
+        // 切换输出方式，输出到文件时启动后台写入线程
+        void Enable(int type)
+        {
+            _type = type;
+            if (type == FILE_TYPE)
+                Start();
         }
 
-        void Flushlog(const std::string& log)
+        // 运行时日志级别，低于这个级别的日志在参数求值之前就被跳过
+        void SetLevel(LOG_LEVEL_T level) { _level = level; }
+        int Level() { return _level; }
+
+        // 以下设置需要在 EnableFILE 之前调用
+        void SetLogFile(const std::string &logfile) { _logfile = logfile; }
+        void SetRollSize(size_t size) { _roll_size = size; }
+        void SetRollInterval(int sec) { _roll_interval = sec; }
+        void SetDropPolicy(LOG_DROP_POLICY_T policy, size_t queue_max = LOG_QUEUE_MAX)
+        {
+            _drop_policy = policy;
+            _queue_max = queue_max > 0 ? queue_max : 1;
+        }
+        // 因队列已满被丢弃的日志字节数
+        uint64_t Dropped() { return _dropped.load(); }
+
+        void FlushLogToScreen(const char *log, size_t len)
         {
             std::unique_lock<std::mutex> lock(_mutex);
+            std::cout.write(log, len);
+        }
+
+        // 追加到当前线程的缓冲区中，缓冲区写满后交给后台线程
+        void FlushLogToFile(const char *log, size_t len)
+        {
+            LogThreadBuffer *tb = ThreadBuffer();
+            std::unique_lock<std::mutex> lock(tb->mutex);
+            if (tb->data.size() + len > LOG_BUFFER_SIZE && tb->data.empty() == false)
+            {
+                std::string full = TakeSpare();
+                full.swap(tb->data);
+                Submit(full);
+            }
+            tb->data.append(log, len);
+        }
+
+        void Flushlog(const char *log, size_t len)
+        {
             switch (_type)
             {
             case SCREEN_TYPE:
-                FlushLogToScreen(log);
+                FlushLogToScreen(log, len);
                 break;
             case FILE_TYPE:
-                FlushLogToFile(log);
+                FlushLogToFile(log, len);
                 break;
             }
         }
@@ -92,55 +255,240 @@ namespace my_muduo
             va_list ap;
             va_start(ap, format);
             char log_info[1024];
-            memset(&log_info, 0, sizeof(log_info));
-            vsnprintf(log_info, sizeof(log_info), format, ap);
+            int len = vsnprintf(log_info, sizeof(log_info), format, ap);
             va_end(ap);
-            Flushlog(log_info);
+            if (len < 0)
+                return;
+            if (len >= (int)sizeof(log_info))
+                len = sizeof(log_info) - 1;
+            Flushlog(log_info, len);
+        }
+
+        // 等待后台线程把已有的日志全部写入文件后退出
+        void Stop()
+        {
+            {
+                std::unique_lock<std::mutex> lock(_queue_mutex);
+                if (_running == false)
+                    return;
+                _running = false;
+            }
+            _cond.notify_one();
+            _writer.join();
+        }
+
+        ~Log() { Stop(); }
+
+    private:
+        LogThreadBuffer *ThreadBuffer()
+        {
+            // 线程退出后缓冲区仍由_thread_buffers持有，剩余的日志由后台线程写完后再释放
+            thread_local std::shared_ptr<LogThreadBuffer> tb;
+            if (!tb)
+            {
+                tb = std::make_shared<LogThreadBuffer>();
+                tb->data.reserve(LOG_BUFFER_SIZE);
+                std::unique_lock<std::mutex> lock(_queue_mutex);
+                _thread_buffers.push_back(tb);
+            }
+            return tb.get();
+        }
+
+        std::string TakeSpare()
+        {
+            std::string buf;
+            std::unique_lock<std::mutex> lock(_queue_mutex);
+            if (_spare.empty() == false)
+            {
+                buf.swap(_spare.back());
+                _spare.pop_back();
+            }
+            else
+            {
+                buf.reserve(LOG_BUFFER_SIZE);
+            }
+            return buf;
+        }
+
+        // 队列已满时按策略丢弃，保证写日志的线程永远不会因为磁盘慢而阻塞
+        void Submit(std::string &buf)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_queue_mutex);
+                if (_queue.size() >= _queue_max)
+                {
+                    if (_drop_policy == LOG_DROP_NEWEST)
+                    {
+                        _dropped += buf.size();
+                        return;
+                    }
+                    _dropped += _queue.front().size();
+                    _queue.erase(_queue.begin());
+                }
+                _queue.push_back(std::string());
+                _queue.back().swap(buf);
+            }
+            _cond.notify_one();
         }
 
-        ~Log()  {}
+        void Start()
+        {
+            std::unique_lock<std::mutex> lock(_queue_mutex);
+            if (_running)
+                return;
+            _running = true;
+            _writer = std::thread(&Log::WriterEntry, this);
+        }
+
+        // 后台写入线程：缓冲区写满立即写入，否则每隔LOG_FLUSH_INTERVAL秒收集各线程未写满的缓冲区一起写入
+        void WriterEntry()
+        {
+            LogFile file(_logfile, _roll_size, _roll_interval);
+            std::vector<std::string> writing;
+            uint64_t reported = 0;
+            bool running = true;
+            while (running)
+            {
+                std::vector<std::shared_ptr<LogThreadBuffer>> buffers;
+                {
+                    std::unique_lock<std::mutex> lock(_queue_mutex);
+                    if (_queue.empty() && _running)
+                        _cond.wait_for(lock, std::chrono::seconds(LOG_FLUSH_INTERVAL));
+                    running = _running;
+                    writing.swap(_queue);
+                    buffers = _thread_buffers;
+                }
+                for (auto &tb : buffers)
+                {
+                    std::unique_lock<std::mutex> lock(tb->mutex);
+                    if (tb->data.empty())
+                        continue;
+                    writing.push_back(std::string());
+                    writing.back().reserve(LOG_BUFFER_SIZE);
+                    writing.back().swap(tb->data);
+                }
+                uint64_t dropped = _dropped.load();
+                if (dropped != reported)
+                {
+                    char notice[128];
+                    snprintf(notice, sizeof(notice), "log queue full, %lu bytes dropped\n", dropped - reported);
+                    writing.push_back(notice);
+                    reported = dropped;
+                }
+                file.Append(writing);
+                Recycle(writing);
+            }
+        }
+
+        // 写完的缓冲区清空后留作备用，并清理已经退出的线程的缓冲区
+        void Recycle(std::vector<std::string> &writing)
+        {
+            std::unique_lock<std::mutex> lock(_queue_mutex);
+            for (auto &buf : writing)
+            {
+                if (_spare.size() >= LOG_SPARE_MAX)
+                    break;
+                buf.clear();
+                _spare.push_back(std::string());
+                _spare.back().swap(buf);
+            }
+            writing.clear();
+            for (size_t i = 0; i < _thread_buffers.size();)
+            {
+                if (_thread_buffers[i].use_count() == 1 && _thread_buffers[i]->data.empty())
+                {
+                    _thread_buffers[i] = _thread_buffers.back();
+                    _thread_buffers.pop_back();
+                    continue;
+                }
+                i++;
+            }
+        }
 
     private:
         int _type;
+        int _level;
         std::string _logfile;
+
+        std::mutex _queue_mutex;                                      // 保护以下等待队列相关的成员
+        std::condition_variable _cond;
+        bool _running;                                                // 后台线程是否在运行
+        std::thread _writer;                                          // 后台写入线程
+        std::vector<std::string> _queue;                              // 已经写满，等待写入文件的缓冲区
+        std::vector<std::string> _spare;                              // 写入完成后留作备用的空缓冲区
+        std::vector<std::shared_ptr<LogThreadBuffer>> _thread_buffers; // 所有线程的缓冲区
+        LOG_DROP_POLICY_T _drop_policy;
+        size_t _queue_max;
+        size_t _roll_size;
+        int _roll_interval;
+        std::atomic<uint64_t> _dropped;
     };
 
     Log lg;
 
 #define LOG_FORMAT(letter, format)  LOG_COLOR_ ##letter #letter " [%s][%s](%d)(%p): " format LOG_RESET_COLOR "\n"
 
+// 编译期日志级别：高于这个级别的日志调用直接被编译掉，参数也不会求值（数值与LOG_LEVEL_T对应）
+#ifndef LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILE_LEVEL 2 // LOG_INFO
+#else
+#define LOG_COMPILE_LEVEL 3 // LOG_DEBUG
+#endif
+#endif
+
 #if defined(__cplusplus) && (__cplusplus >  201703L)
-#define LOG_LEVEL(level, format, ...) do {                     \
-        if (level == LOG_ERROR )          { lg.LogWrite(LOG_FORMAT(E, format), LogTimestamp().c_str(), GetRelativePath(__FILE__).c_str(), __LINE__, getpid(), __VA_OPT__(,) __VA_ARGS__); } \
-        else if (level == LOG_WARN )      { lg.LogWrite(LOG_FORMAT(W, format), LogTimestamp().c_str(), GetRelativePath(__FILE__).c_str(), __LINE__, getpid(), __VA_OPT__(,) __VA_ARGS__); } \
-        else if (level == LOG_DEBUG )     { lg.LogWrite(LOG_FORMAT(D, format), LogTimestamp().c_str(), GetRelativePath(__FILE__).c_str(), __LINE__, getpid(), __VA_OPT__(,) __VA_ARGS__); } \
-        else                              { lg.LogWrite(LOG_FORMAT(I, format), LogTimestamp().c_str(), GetRelativePath(__FILE__).c_str(), __LINE__, getpid(), __VA_OPT__(,) __VA_ARGS__); } \
+#define LOG_LEVEL(level, letter, format, ...) do {                     \
+        if (lg.Level() >= level) {                                     \
+            constexpr const char *log_source = LogSourceName(__FILE__); \
+            lg.LogWrite(LOG_FORMAT(letter, format), LogTimestamp(), log_source, __LINE__, (void*)pthread_self() __VA_OPT__(,) __VA_ARGS__); \
+        }                                                              \
     } while(0)
 #else // !(defined(__cplusplus) && (__cplusplus >  201703L))
-#define LOG_LEVEL(level, format, ...) do {                     \
-        if (level == LOG_ERROR )          { lg.LogWrite(LOG_FORMAT(E, format), LogTimestamp().c_str(), GetRelativePath(__FILE__).c_str(), __LINE__, (void*)pthread_self(), ##__VA_ARGS__); } \
-        else if (level == LOG_WARN )      { lg.LogWrite(LOG_FORMAT(W, format), LogTimestamp().c_str(), GetRelativePath(__FILE__).c_str(), __LINE__, (void*)pthread_self(), ##__VA_ARGS__); } \
-        else if (level == LOG_DEBUG )     { lg.LogWrite(LOG_FORMAT(D, format), LogTimestamp().c_str(), GetRelativePath(__FILE__).c_str(), __LINE__, (void*)pthread_self(), ##__VA_ARGS__); } \
-        else                              { lg.LogWrite(LOG_FORMAT(I, format), LogTimestamp().c_str(), GetRelativePath(__FILE__).c_str(), __LINE__, (void*)pthread_self(), ##__VA_ARGS__); } \
+#define LOG_LEVEL(level, letter, format, ...) do {                     \
+        if (lg.Level() >= level) {                                     \
+            constexpr const char *log_source = LogSourceName(__FILE__); \
+            lg.LogWrite(LOG_FORMAT(letter, format), LogTimestamp(), log_source, __LINE__, (void*)pthread_self(), ##__VA_ARGS__); \
+        }                                                              \
     } while(0)
 #endif
 
-#define LOG_LEVEL_LOCAL(level, format, ...) do {   \
-        LOG_LEVEL(level, format, ##__VA_ARGS__);   \
+#define LOG_LEVEL_LOCAL(level, letter, format, ...) do {   \
+        LOG_LEVEL(level, letter, format, ##__VA_ARGS__);   \
     } while(0)
 
+#define LOG_DISABLED(format, ...) do { } while(0)
+
 #if defined(__cplusplus) && (__cplusplus >  201703L)
-#define LOGE(format, ... ) LOG_LEVEL_LOCAL(LOG_ERROR,   format __VA_OPT__(,) __VA_ARGS__)
-#define LOGW(format, ... ) LOG_LEVEL_LOCAL(LOG_WARN ,   format __VA_OPT__(,) __VA_ARGS__)
-#define LOGI(format, ... ) LOG_LEVEL_LOCAL(LOG_INFO ,   format __VA_OPT__(,) __VA_ARGS__)
-#define LOGD(format, ... ) LOG_LEVEL_LOCAL(LOG_DEBUG,   format __VA_OPT__(,) __VA_ARGS__)
+#define LOGE(format, ... ) LOG_LEVEL_LOCAL(LOG_ERROR, E, format __VA_OPT__(,) __VA_ARGS__)
 #else // !(defined(__cplusplus) && (__cplusplus >  201703L))
-#define LOGE(format, ... ) LOG_LEVEL_LOCAL(LOG_ERROR,   format, ##__VA_ARGS__)
-#define LOGW(format, ... ) LOG_LEVEL_LOCAL(LOG_WARN ,   format, ##__VA_ARGS__)
-#define LOGI(format, ... ) LOG_LEVEL_LOCAL(LOG_INFO ,   format, ##__VA_ARGS__)
-#define LOGD(format, ... ) LOG_LEVEL_LOCAL(LOG_DEBUG,   format, ##__VA_ARGS__)
+#define LOGE(format, ... ) LOG_LEVEL_LOCAL(LOG_ERROR, E, format, ##__VA_ARGS__)
 #endif // !(defined(__cplusplus) && (__cplusplus >  201703L))
 
+#if LOG_COMPILE_LEVEL < 1
+#define LOGW LOG_DISABLED
+#elif defined(__cplusplus) && (__cplusplus >  201703L)
+#define LOGW(format, ... ) LOG_LEVEL_LOCAL(LOG_WARN , W, format __VA_OPT__(,) __VA_ARGS__)
+#else
+#define LOGW(format, ... ) LOG_LEVEL_LOCAL(LOG_WARN , W, format, ##__VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL < 2
+#define LOGI LOG_DISABLED
+#elif defined(__cplusplus) && (__cplusplus >  201703L)
+#define LOGI(format, ... ) LOG_LEVEL_LOCAL(LOG_INFO , I, format __VA_OPT__(,) __VA_ARGS__)
+#else
+#define LOGI(format, ... ) LOG_LEVEL_LOCAL(LOG_INFO , I, format, ##__VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL < 3
+#define LOGD LOG_DISABLED
+#elif defined(__cplusplus) && (__cplusplus >  201703L)
+#define LOGD(format, ... ) LOG_LEVEL_LOCAL(LOG_DEBUG, D, format __VA_OPT__(,) __VA_ARGS__)
+#else
+#define LOGD(format, ... ) LOG_LEVEL_LOCAL(LOG_DEBUG, D, format, ##__VA_ARGS__)
+#endif
+
 #define EnableScreen()          \
     do                          \
     {                           \
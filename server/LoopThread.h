@@ -13,6 +13,7 @@ namespace my_muduo
         std::condition_variable _cond; // 条件变量
         EventLoop *_loop;              // EventLoop指针变量，这个对象需要在线程内实例化。
         std::thread _thread;           // EventLoop对应的线程
+        bool _exited;                  // 事件循环是否已经退出，退出后_loop不再可用
 
     private:
         // 实例化一个EventLoop对象，唤醒_cond上有可能阻塞的线程，并开始运行EventLoop对象
@@ -25,11 +26,26 @@ namespace my_muduo
                 _cond.notify_all();
             }
             loop.Start();
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _loop = nullptr;
+                _exited = true;
+            }
         }
 
     public:
         // 创建线程，设定线程入口函数
-        LoopThread() : _loop(nullptr), _thread(std::thread(&LoopThread::ThreadEntry, this)) {}
+        LoopThread() : _loop(nullptr), _exited(false)
+        {
+            // _thread 最后再启动，保证线程入口函数使用的成员都已经初始化
+            _thread = std::thread(&LoopThread::ThreadEntry, this);
+        }
+
+        ~LoopThread()
+        {
+            Quit();
+            Join();
+        }
 
         // 返回当前线程关联的EventLoop对象指针
         EventLoop *GetLoop()
@@ -38,10 +54,25 @@ namespace my_muduo
             {
                 std::unique_lock<std::mutex> lock(_mutex);
                 _cond.wait(lock, [&]()
-                           { return _loop != nullptr; });
+                           { return _loop != nullptr || _exited; });
                 loop = _loop;
             }
             return loop;
         }
+
+        // 通知事件循环退出
+        void Quit()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_loop)
+                _loop->Quit();
+        }
+
+        // 等待线程退出
+        void Join()
+        {
+            if (_thread.joinable())
+                _thread.join();
+        }
     };
 }
\ No newline at end of file
@@ -5,33 +5,85 @@
 
 namespace my_muduo
 {
+    // 线程池中loop的增删以及连接分配，都必须在baseloop线程中进行（Create之前除外）
     class LoopThreadPool
     {
     private:
         int _thread_count;
         int _next_idx;
+        std::atomic<bool> _started;
         EventLoop *_baseloop;
         std::vector<LoopThread *> _threads;
         std::vector<EventLoop *> _loops;
 
     public:
-        LoopThreadPool(EventLoop *baseloop) : _thread_count(0), _next_idx(0), _baseloop(baseloop) {}
+        LoopThreadPool(EventLoop *baseloop) : _thread_count(0), _next_idx(0), _started(false), _baseloop(baseloop) {}
+        ~LoopThreadPool() { Stop(); }
+        // Create之前设置线程数量，Create之后调整线程数量使用AddLoop/RetireLoop
         void SetThreadCount(int count) { _thread_count = count; }
+        bool Started() { return _started; }
+        int ThreadCount() { return _thread_count; }
         void Create()
         {
-            if (_thread_count > 0)
-            {
-                _threads.resize(_thread_count);
-                _loops.resize(_thread_count);
-                for (int i = 0; i < _thread_count; i++)
-                {
-                    _threads[i] = new LoopThread();
-                    _loops[i] = _threads[i]->GetLoop();
-                }
-            }
+            _started = true;
+            int count = _thread_count;
+            _thread_count = 0;
+            for (int i = 0; i < count; i++)
+                AddLoop();
             return;
         }
 
+        // 运行时新增一个从属线程，新线程立即参与连接分配
+        EventLoop *AddLoop()
+        {
+            LoopThread *thread = new LoopThread();
+            _threads.push_back(thread);
+            _loops.push_back(thread->GetLoop());
+            _thread_count = _loops.size();
+            return _loops.back();
+        }
+
+        // 运行时移除最后一个从属线程，移除后不会再给它分配新连接
+        // 返回的线程由调用者负责：处理完挂在上面的连接后delete（退出事件循环并等待线程退出）
+        LoopThread *RetireLoop()
+        {
+            if (_threads.empty())
+                return nullptr;
+            LoopThread *thread = _threads.back();
+            _threads.pop_back();
+            _loops.pop_back();
+            _thread_count = _loops.size();
+            if (_next_idx >= _thread_count)
+                _next_idx = 0;
+            return thread;
+        }
+
+        // 退出所有从属线程的事件循环，并等待线程退出
+        void Stop()
+        {
+            for (auto &thread : _threads)
+                thread->Quit();
+            for (auto &thread : _threads)
+                delete thread;
+            _threads.clear();
+            _loops.clear();
+            _thread_count = 0;
+        }
+
+        // 可分配连接的loop数量，没有从属线程时只有baseloop
+        int LoopCount()
+        {
+            return _thread_count == 0 ? 1 : _thread_count;
+        }
+
+        // 获取所有可分配连接的loop
+        std::vector<EventLoop *> Loops()
+        {
+            if (_thread_count == 0)
+                return std::vector<EventLoop *>(1, _baseloop);
+            return _loops;
+        }
+
         EventLoop *NextLoop()
         {
             if(_thread_count == 0)
@@ -53,6 +53,11 @@ namespace my_muduo
                 abort();
             }
         }
+        ~Poller()
+        {
+            close(_epfd);
+        }
+
         // 添加或修改监控事件
         void UpdateEvent(Channel *channel)
         {
@@ -65,13 +70,13 @@ namespace my_muduo
 
             return Update(channel, EPOLL_CTL_MOD);
         }
-        // 移除监控
+        // 移除监控，没有添加监控时直接返回（比如迁移中的连接已经移除过一次）
         void RemoveEvent(Channel *channel)
         {
             auto it = _channels.find(channel->Fd());
-            if (it != _channels.end())
-                _channels.erase(it);
-
+            if (it == _channels.end())
+                return;
+            _channels.erase(it);
             return Update(channel, EPOLL_CTL_DEL);
         }
 
@@ -7,6 +7,9 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <cerrno>
 #include "Log.h"
 
 namespace my_muduo
@@ -77,13 +80,15 @@ namespace my_muduo
             }
             return true;
         }
-        // 获取新连接
-        int Accept()
+        // 获取新连接，默认直接将新连接设置为非阻塞和CLOEXEC，省去后续的fcntl
+        // 返回-1时由调用者根据errno判断原因（EAGAIN表示已经没有待获取的连接了）
+        int Accept(int flag = SOCK_NONBLOCK | SOCK_CLOEXEC)
         {
-            int newfd = accept(_sockfd, NULL, NULL);
+            int newfd = accept4(_sockfd, NULL, NULL, flag);
             if (newfd < 0)
             {
-                LOGE("socket accept failed!");
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    LOGE("socket accept failed: %s", strerror(errno));
                 return -1;
             }
             return newfd;
@@ -131,6 +136,70 @@ namespace my_muduo
                 return 0;
             return Send(buf, len, MSG_DONTWAIT); // MSG_DONTWAIT 表示当前发送为非阻塞。
         }
+        // 一次发送多块不连续的数据，返回值的含义与Send相同
+        ssize_t NonBlockSendV(struct iovec *iov, int cnt)
+        {
+            if (cnt == 0)
+                return 0;
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = cnt;
+            ssize_t ret = sendmsg(_sockfd, &msg, MSG_DONTWAIT);
+            if (ret < 0)
+            {
+                if (errno == EAGAIN || errno == EINTR)
+                {
+                    return 0;
+                }
+                LOGE("socket sendmsg failed!!");
+                return -1;
+            }
+            return ret;
+        }
+        // 从文件描述符直接发送数据，不经过用户空间，offset随发送的长度向后移动
+        ssize_t NonBlockSendFile(int in_fd, off_t *offset, size_t len)
+        {
+            if (len == 0)
+                return 0;
+            ssize_t ret = sendfile(_sockfd, in_fd, offset, len);
+            if (ret < 0)
+            {
+                if (errno == EAGAIN || errno == EINTR)
+                {
+                    return 0;
+                }
+                LOGE("socket sendfile failed!!");
+                return -1;
+            }
+            if (ret == 0)
+            {
+                // 文件被截断，已经无法发送约定的长度
+                LOGE("sendfile reached end of file!!");
+                return -1;
+            }
+            return ret;
+        }
+        // 把套接字中的数据直接移动到管道中，不经过用户空间，返回值的含义与Recv相同
+        ssize_t NonBlockSplice(int pipefd, size_t len)
+        {
+            ssize_t ret = splice(_sockfd, NULL, pipefd, NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (ret < 0)
+            {
+                if (errno == EAGAIN || errno == EINTR)
+                {
+                    return 0;
+                }
+                LOGE("socket splice failed!!");
+                return -1;
+            }
+            if (ret == 0)
+            {
+                // 对端关闭了连接
+                return -1;
+            }
+            return ret;
+        }
         // 关闭套接字
         void Close()
         {
@@ -148,11 +217,12 @@ namespace my_muduo
                 return false;
             if (block_flag)
                 NonBlock();
+            // 地址重用必须在绑定之前设置才会生效，否则重启时会因为TIME_WAIT绑定失败
+            ReuseAddress();
             if (Bind(ip, port) == false)
                 return false;
             if (Listen() == false)
                 return false;
-            ReuseAddress();
             return true;
         }
         // 创建一个客户端连接
@@ -4,21 +4,52 @@
 #include "EventLoop.h"
 #include "LoopThreadPool.h"
 #include "Connection.h"
+#include "Handoff.h"
 #include <signal.h>
+#include <atomic>
 
 namespace my_muduo
 {
+    typedef enum
+    {
+        OVERLOAD_PAUSE_ACCEPT, /* 达到连接上限后暂停获取新连接，新连接留在内核全连接队列中 */
+        OVERLOAD_REJECT        /* 达到连接上限后获取新连接，发送预设的响应后立即关闭 */
+    } OverloadPolicy;
+
+#define DEFAULT_HANDOFF_GRACE 30 // 交出监听套接字后，默认等待已有连接处理完毕的秒数
+#define DEFAULT_DRAIN_GRACE 30   // 回收从属线程时，默认等待连接迁移走的秒数
+#define REBALANCE_MIN_EVENTS 1024 // 一个统计周期内最忙loop处理的事件少于这个数量时不做均衡
+
     class TCPServer
     {
     private:
-        uint64_t _next_id; // 这是一个自增长的连接ID
         int _port;
         int _timeout;                  // 这是非活跃连接的统计时间 ———— 多长时间无通信就是非活跃连接
         bool _enable_inactive_release; // 是否启动非活跃连接超时销毁的判断标志
         EventLoop _baseloop;           // 这是主线程的EventLoop对象，负责监听事件的处理
         Acceptor _acceptor;            // 这是监听套接字的管理对象
-        LoopThreadPool _pool;          // 从属EventLoop线程池
-        std::unordered_map<uint64_t, PtrConnection> _conns;
+        LoopThreadPool _pool;          // 从属EventLoop线程池，连接由各自所属的EventLoop管理
+
+        size_t _max_conns;                 // 服务器最大连接数量，0表示不限制
+        size_t _max_conns_per_loop;        // 每个loop最大连接数量，0表示不限制
+        OverloadPolicy _overload_policy;   // 达到连接上限后的处理策略
+        std::string _overload_response;    // OVERLOAD_REJECT策略下关闭连接前发送的数据
+        std::atomic<size_t> _conn_count;   // 当前连接数量
+        std::atomic<uint64_t> _rejected;   // 因过载被拒绝的连接数量
+        std::atomic<bool> _accept_paused;  // 当前是否暂停获取新连接
+
+        std::string _handoff_path;                 // 进程交接使用的Unix域套接字路径，为空表示不启用
+        int _handoff_grace;                        // 交出监听套接字后，等待已有连接处理完毕的最长时间（秒）
+        int _drain_grace;                          // 回收从属线程时，等待连接迁移走的最长时间（秒）
+        int _handoff_fd;                           // 交接监听套接字
+        std::unique_ptr<Channel> _handoff_channel; // 交接监听套接字的事件管理
+        bool _draining;                            // 监听套接字已经交出，正在等待已有连接处理完毕
+        bool _drain_forced;                        // 是否已经强制关闭剩余的连接
+        time_t _drain_deadline;                    // 等待已有连接处理完毕的截止时间
+
+        int _rebalance_interval;                               // 连接自动均衡的统计周期（秒），0表示不启用
+        double _rebalance_ratio;                               // 最忙loop的负载超过最闲loop的多少倍时迁移连接
+        std::unordered_map<EventLoop *, uint64_t> _loop_events; // 上一个统计周期结束时各个loop处理过的事件总数
 
         using ConnectedCallBack = std::function<void(const PtrConnection &)>;
         using MessageCallBack = std::function<void(const PtrConnection &, Buffer *)>;
@@ -31,47 +62,355 @@ namespace my_muduo
         AnyEventCallBack _event_callback;
 
     private:
-        // 为新链接构造connection进行管理
+        // 判断当前是否还能接收新连接，能则返回分配的loop，否则返回nullptr
+        EventLoop *AdmitLoop()
+        {
+            if (_max_conns > 0 && _conn_count.load() >= _max_conns)
+                return nullptr;
+            int count = _pool.LoopCount();
+            for (int i = 0; i < count; i++)
+            {
+                EventLoop *loop = _pool.NextLoop();
+                if (_max_conns_per_loop == 0 || loop->ConnectionCount() < _max_conns_per_loop)
+                    return loop;
+            }
+            return nullptr;
+        }
+
+        // 连接数最少的loop，暂停策略下已经获取的连接超过上限时分配给它
+        EventLoop *LeastLoadedLoop()
+        {
+            EventLoop *least = nullptr;
+            for (auto &loop : _pool.Loops())
+            {
+                if (least == nullptr || loop->ConnectionCount() < least->ConnectionCount())
+                    least = loop;
+            }
+            return least;
+        }
+
+        // 服务器是否已经满载：总连接数达到上限，或者所有loop的连接数都达到上限
+        bool Full()
+        {
+            if (_max_conns > 0 && _conn_count.load() >= _max_conns)
+                return true;
+            if (_max_conns_per_loop == 0)
+                return false;
+            for (auto &loop : _pool.Loops())
+            {
+                if (loop->ConnectionCount() < _max_conns_per_loop)
+                    return false;
+            }
+            return true;
+        }
+
+        // 拒绝新连接：按照策略发送预设响应后直接关闭
+        void RejectConnection(int fd)
+        {
+            _rejected++;
+            if (_overload_policy == OVERLOAD_REJECT && _overload_response.empty() == false)
+                send(fd, _overload_response.c_str(), _overload_response.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+            close(fd);
+        }
+
+        void PauseAcceptInLoop()
+        {
+            _acceptor.Pause();
+            _accept_paused = true;
+            LOGW("too many connections(%lu), pause accept", _conn_count.load());
+            // 设置暂停标志之前，有可能已经有连接在其他线程中释放了，且没有看到暂停标志，这里再检查一次
+            if (Full() == false)
+                ResumeAcceptInLoop();
+        }
+
+        void ResumeAcceptInLoop()
+        {
+            if (_accept_paused == false || _draining || Full())
+                return;
+            _acceptor.Resume();
+            _accept_paused = false;
+            LOGI("connections(%lu) below limit, resume accept", _conn_count.load());
+        }
+
+        // 新链接的准入判断，在baseloop中执行，连接对象的构造交给分配的loop去做
         void NewConnection(int fd)
         {
-            _next_id++;
-            PtrConnection conn(new Connection(_pool.NextLoop(), _next_id, fd));
+            EventLoop *loop = AdmitLoop();
+            if (loop == nullptr)
+            {
+                if (_overload_policy != OVERLOAD_PAUSE_ACCEPT)
+                    return RejectConnection(fd);
+                // 暂停策略下连接已经获取（客户端已经完成握手），不关闭，超出上限交给连接最少的loop，之后暂停获取
+                loop = LeastLoadedLoop();
+            }
+            _conn_count++;
+            loop->IncConnectionCount();
+            loop->RunInLoop(std::bind(&TCPServer::NewConnectionInLoop, this, loop, fd));
+            // 暂停策略下，达到上限后主动停止获取，剩余的新连接留在全连接队列中等待
+            if (_overload_policy == OVERLOAD_PAUSE_ACCEPT && Full())
+                PauseAcceptInLoop();
+        }
+
+        // 为新链接构造connection进行管理，在连接所属的loop中执行
+        void NewConnectionInLoop(EventLoop *loop, int fd)
+        {
+            uint64_t id = loop->NextId();
+            PtrConnection conn(new Connection(loop, id, fd));
             conn->SetMessageCallBack(_message_callback);
             conn->SetCloseCallBack(_closed_callback);
             conn->SetConnectionCallBack(_connected_callback);
             conn->SetAnyEventCallBack(_event_callback);
             conn->SetSrvClosesCallBack(std::bind(&TCPServer::RemoveConnection, this, std::placeholders::_1));
+            loop->AddConnection(id, conn);
             if (_enable_inactive_release)
                 conn->EnableInactiveRelease(_timeout);
             conn->Established();
-            _conns.insert(std::make_pair(_next_id, conn));
         }
 
-        // 从管理的connection的_conns中移除连接信息
-        void RemoveConnectionInLoop(const PtrConnection &conn)
+        // 从连接所属loop中移除连接信息，连接释放时本身就在所属loop中，不需要再转到baseloop
+        void RemoveConnection(const PtrConnection &conn)
+        {
+            EventLoop *loop = conn->GetLoop();
+            loop->RemoveConnection(conn->Id());
+            loop->DecConnectionCount();
+            _conn_count--;
+            if (_accept_paused)
+                _baseloop.RunInLoop(std::bind(&TCPServer::ResumeAcceptInLoop, this));
+        }
+
+        void RunAfterInLoop(const Functor &task, int delay)
+        {
+            _baseloop.TimerAdd(_baseloop.NextId(), delay, task);
+        }
+
+        // 调整从属线程数量，在baseloop中执行
+        // 一次回收多个线程时，先把它们全部移出线程池，再开始迁移连接，迁移目标只包含留下的loop，
+        // 否则连接可能被迁移到随后也要回收的loop上，甚至在那个loop已经释放之后才迁移过去
+        void SetThreadCountInLoop(int count)
         {
-            int id = conn->Id();
-            auto it = _conns.find(id);
-            if (it != _conns.end())
+            while (_pool.ThreadCount() < count)
+                _pool.AddLoop();
+            std::vector<LoopThread *> retired;
+            while (_pool.ThreadCount() > count)
             {
-                _conns.erase(it);
+                LoopThread *thread = _pool.RetireLoop();
+                if (thread == nullptr)
+                    break;
+                retired.push_back(thread);
             }
+            std::vector<EventLoop *> targets = _pool.Loops();
+            for (auto &thread : retired)
+                RetireLoopInLoop(thread, targets);
         }
-        void RemoveConnection(const PtrConnection &conn)
+
+        // 回收一个已经移出线程池的从属线程：不再给它分配新连接，把挂在上面的连接迁移到targets上
+        // targets各计入一个连接数，回收结束之前它们即使随后也被回收，也不会因为没有连接被释放
+        void RetireLoopInLoop(LoopThread *thread, const std::vector<EventLoop *> &targets)
         {
-            _baseloop.RunInLoop(std::bind(&TCPServer::RemoveConnectionInLoop, this, conn));
+            EventLoop *loop = thread->GetLoop();
+            LOGI("retire loop %p with %lu connections", loop, loop->ConnectionCount());
+            for (auto &target : targets)
+                target->IncConnectionCount();
+            loop->RunInLoop(std::bind(&TCPServer::DrainLoop, this, thread, targets, time(nullptr) + _drain_grace));
         }
 
-        void RunAfterInLoop(const Functor &task, int delay)
+        // 在被回收的线程中每秒执行一次：将连接轮流迁移到targets上（正在关闭和正在迁移的连接不会迁移），
+        // 之后才迁移过来的连接在下一次执行时继续迁移走，超过等待时间则直接释放剩余连接，连接全部移走后回收线程
+        void DrainLoop(LoopThread *thread, const std::vector<EventLoop *> &targets, time_t deadline)
+        {
+            EventLoop *loop = thread->GetLoop();
+            if (loop->ConnectionCount() == 0)
+            {
+                for (auto &target : targets)
+                    target->DecConnectionCount();
+                // 线程不能等待自己退出，交给baseloop去回收
+                _baseloop.QueueInLoop(std::bind(&TCPServer::DeleteLoopThread, thread));
+                return;
+            }
+            if (time(nullptr) < deadline)
+            {
+                size_t idx = 0;
+                loop->ForEachConnection([&](const PtrConnection &conn)
+                                        { conn->MigrateTo(targets[idx++ % targets.size()]); });
+            }
+            else
+                loop->ForEachConnection(std::bind(&Connection::Release, std::placeholders::_1));
+            loop->TimerAdd(loop->NextId(), 1, std::bind(&TCPServer::DrainLoop, this, thread, targets, deadline));
+        }
+
+        // 退出线程的事件循环并等待线程退出
+        static void DeleteLoopThread(LoopThread *thread)
         {
-            _next_id++;
-            _baseloop.TimerAdd(_next_id, delay, task);
+            delete thread;
+        }
+
+        // 根据各个loop在上一个统计周期内处理的事件数量，把最忙loop上的一个连接迁移到最闲的loop上
+        void RebalanceInLoop()
+        {
+            std::vector<EventLoop *> loops = _pool.Loops();
+            std::unordered_map<EventLoop *, uint64_t> totals;
+            EventLoop *hot = nullptr, *cold = nullptr;
+            uint64_t hot_load = 0, cold_load = 0;
+            for (auto &loop : loops)
+            {
+                uint64_t total = loop->EventCount();
+                auto it = _loop_events.find(loop);
+                uint64_t load = it == _loop_events.end() ? 0 : total - it->second;
+                totals[loop] = total;
+                if (hot == nullptr || load > hot_load)
+                {
+                    hot = loop;
+                    hot_load = load;
+                }
+                if (cold == nullptr || load < cold_load)
+                {
+                    cold = loop;
+                    cold_load = load;
+                }
+            }
+            _loop_events.swap(totals);
+            EventLoop *source = nullptr;
+            if (hot != cold && hot_load >= REBALANCE_MIN_EVENTS && hot_load > cold_load * _rebalance_ratio &&
+                hot->ConnectionCount() > 1)
+            {
+                // cold此时还在线程池中，先计入一个连接数，迁移任务执行之前cold即使被回收也不会被释放
+                source = hot;
+                cold->IncConnectionCount();
+                hot->RunInLoop(std::bind(&TCPServer::MigrateOneConnection, hot, cold, hot_load, (hot_load - cold_load) / 2));
+            }
+            // 其他loop也清零各个连接的事件计数，下一个周期的计数只包含这个周期之后的事件
+            for (auto &loop : loops)
+            {
+                if (loop != source)
+                    loop->RunInLoop(std::bind(&TCPServer::ResetEventCounts, loop));
+            }
+            RunAfterInLoop(std::bind(&TCPServer::RebalanceInLoop, this), _rebalance_interval);
+        }
+
+        // 在最忙的loop中执行：按连接触发事件的占比估算每个连接的负载，
+        // 选出不超过两个loop负载差一半的最大的那个连接迁移走，避免只是把热点换了一个地方
+        // target在RebalanceInLoop中计入的连接数在这里撤销，MigrateTo会为迁移的连接重新计入
+        static void MigrateOneConnection(EventLoop *source, EventLoop *target, uint64_t source_load, uint64_t limit)
+        {
+            std::vector<std::pair<PtrConnection, uint64_t>> counts;
+            uint64_t sum = 0;
+            source->ForEachConnection([&](const PtrConnection &conn)
+                                      {
+                                          uint64_t count = conn->TakeEventCount();
+                                          sum += count;
+                                          counts.push_back(std::make_pair(conn, count)); });
+            if (sum == 0)
+                return target->DecConnectionCount();
+            PtrConnection best;
+            uint64_t best_load = 0;
+            for (auto &it : counts)
+            {
+                uint64_t load = it.second * source_load / sum;
+                if (load > best_load && load <= limit)
+                {
+                    best = it.first;
+                    best_load = load;
+                }
+            }
+            if (best)
+                best->MigrateTo(target);
+            target->DecConnectionCount();
+        }
+
+        // 清零loop上各个连接的事件计数，在该loop中执行
+        static void ResetEventCounts(EventLoop *loop)
+        {
+            loop->ForEachConnection([](const PtrConnection &conn)
+                                    { conn->TakeEventCount(); });
+        }
+
+        // 从旧进程继承监听套接字，没有旧进程时返回-1
+        static int InheritListenFd(const std::string &handoff_path)
+        {
+            if (handoff_path.empty())
+                return -1;
+            std::vector<int> fds = Handoff::Inherit(handoff_path);
+            if (fds.empty())
+                return -1;
+            for (size_t i = 1; i < fds.size(); i++)
+                close(fds[i]);
+            return fds[0];
+        }
+
+        // 启动交接监听，等待新进程来获取监听套接字
+        void ServeHandoff()
+        {
+            _handoff_fd = Handoff::Listen(_handoff_path);
+            if (_handoff_fd < 0)
+                return;
+            _handoff_channel.reset(new Channel(&_baseloop, _handoff_fd));
+            _handoff_channel->SetReadCallBack(std::bind(&TCPServer::HandleHandoff, this));
+            _handoff_channel->EnableRead();
+        }
+
+        // 不再提供交接，新进程已经重新创建了同路径的套接字文件，这里只关闭描述符
+        void StopHandoff()
+        {
+            if (_handoff_fd < 0)
+                return;
+            _handoff_channel->Remove();
+            close(_handoff_fd);
+            _handoff_fd = -1;
+        }
+
+        // 新进程连接上来：发送监听套接字，然后停止获取新连接，等待已有连接处理完毕
+        void HandleHandoff()
+        {
+            int fd = accept4(_handoff_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (fd < 0)
+                return;
+            if (Handoff::CheckPeer(fd) == false)
+            {
+                LOGW("reject handoff request from other user");
+                close(fd);
+                return;
+            }
+            std::vector<int> fds(1, _acceptor.Fd());
+            bool ret = Handoff::SendFds(fd, fds);
+            close(fd);
+            if (ret == false)
+                return;
+            LOGI("listen fd handed off, draining %lu connections", _conn_count.load());
+            StopHandoff();
+            _acceptor.Stop();
+            _draining = true;
+            _drain_deadline = time(nullptr) + _handoff_grace;
+            DrainCheck();
+        }
+
+        // 每秒检查一次：连接都处理完毕则退出；超过等待时间则关闭剩余连接，再过1秒无论如何都退出
+        void DrainCheck()
+        {
+            time_t now = time(nullptr);
+            if (_conn_count.load() == 0 || now > _drain_deadline)
+            {
+                LOGI("drain finished, %lu connections left", _conn_count.load());
+                _pool.Stop();
+                _baseloop.Quit();
+                return;
+            }
+            if (_drain_forced == false && now >= _drain_deadline)
+            {
+                _drain_forced = true;
+                ForEachConnection(std::bind(&Connection::ShutDown, std::placeholders::_1));
+            }
+            RunAfterInLoop(std::bind(&TCPServer::DrainCheck, this), 1);
         }
 
     public:
-        TCPServer(int port)
-            : _port(port), _next_id(0), _enable_inactive_release(false), _acceptor(&_baseloop, port),
-              _pool(&_baseloop)
+        // handoff_path 不为空时启用不停机重启：启动时先尝试从该路径上运行的旧进程继承监听套接字，
+        // 启动后在该路径上等待下一个新进程来获取监听套接字
+        TCPServer(int port, const std::string &handoff_path = "")
+            : _port(port), _enable_inactive_release(false), _acceptor(&_baseloop, port, InheritListenFd(handoff_path)),
+              _pool(&_baseloop), _max_conns(0), _max_conns_per_loop(0), _overload_policy(OVERLOAD_PAUSE_ACCEPT),
+              _conn_count(0), _rejected(0), _accept_paused(false), _handoff_path(handoff_path),
+              _handoff_grace(DEFAULT_HANDOFF_GRACE), _drain_grace(DEFAULT_DRAIN_GRACE), _handoff_fd(-1), _draining(false), _drain_forced(false),
+              _drain_deadline(0), _rebalance_interval(0), _rebalance_ratio(2.0)
         {
 
             // 设置回调函数
@@ -80,17 +419,66 @@ namespace my_muduo
             _acceptor.Listen();
         }
 
-        void SetThreadCount(int count) { return _pool.SetThreadCount(count); }
+        // 设置从属线程数量，Start之后调用则在运行时增加或回收线程
+        // 被回收的线程不再分配新连接，挂在上面的连接迁移到留下的线程，等待时间（SetDrainGrace）过后仍没有迁移走的连接被释放，全部释放后线程退出
+        void SetThreadCount(int count)
+        {
+            if (count < 0)
+                count = 0;
+            if (_pool.Started() == false)
+                return _pool.SetThreadCount(count);
+            _baseloop.RunInLoop(std::bind(&TCPServer::SetThreadCountInLoop, this, count));
+        }
         void SetConnectionCallBack(const ConnectedCallBack &cb) { _connected_callback = cb; }
         void SetMessageCallBack(const MessageCallBack &cb) { _message_callback = cb; }
         void SetCloseCallBack(const ClosedCallBack &cb) { _closed_callback = cb; }
         void SetAnyEventCallBack(const AnyEventCallBack &cb) { _event_callback = cb; }
 
+        // 设置连接上限（在Start之前调用），0表示不限制
+        void SetMaxConnections(size_t max_conns, size_t max_conns_per_loop = 0)
+        {
+            _max_conns = max_conns;
+            _max_conns_per_loop = max_conns_per_loop;
+        }
+        // 设置达到连接上限后的处理策略，response为OVERLOAD_REJECT策略下关闭连接前发送的数据
+        void SetOverloadPolicy(OverloadPolicy policy, const std::string &response = "")
+        {
+            _overload_policy = policy;
+            _overload_response = response;
+        }
+        // 准入状态统计，可以在任意线程中读取
+        size_t ConnectionCount() { return _conn_count.load(); }
+        uint64_t RejectedCount() { return _rejected.load(); }
+        bool AcceptPaused() { return _accept_paused.load(); }
+
+        // 设置交出监听套接字后，等待已有连接处理完毕的最长时间
+        void SetHandoffGrace(int sec) { _handoff_grace = sec; }
+        // 设置回收从属线程时，等待连接迁移走的最长时间，超过后释放剩余的连接
+        void SetDrainGrace(int sec) { _drain_grace = sec; }
+
+        // 启动连接自动均衡：每interval秒统计一次各个loop的负载，
+        // 最忙loop的负载超过最闲loop的ratio倍时，迁移一个连接到最闲的loop上（在Start之前调用）
+        void EnableRebalance(int interval, double ratio = 2.0)
+        {
+            bool started = _rebalance_interval > 0;
+            _rebalance_interval = interval > 0 ? interval : 1;
+            _rebalance_ratio = ratio;
+            if (started == false)
+                RunAfter(std::bind(&TCPServer::RebalanceInLoop, this), _rebalance_interval);
+        }
+
         void EnableInactiveRelease(int timeout)
         {
             _timeout = timeout;
             _enable_inactive_release = true;
         }
+        // 对所有连接执行cb，分发到每个连接所属的loop中执行（在Start之后调用）
+        void ForEachConnection(const std::function<void(const PtrConnection &)> &cb)
+        {
+            for (auto &loop : _pool.Loops())
+                loop->RunInLoop(std::bind(&EventLoop::ForEachConnection, loop, cb));
+        }
+
         void RunAfter(const Functor &task, int delay)
         {
             _baseloop.RunInLoop(std::bind(&TCPServer::RunAfterInLoop, this, task, delay));
@@ -100,7 +488,9 @@ namespace my_muduo
         {
             // 创建线程池的从属线程
             _pool.Create();
-            // 启动服务器
+            if (_handoff_path.empty() == false)
+                ServeHandoff();
+            // 启动服务器，交出监听套接字并处理完已有连接后返回
             _baseloop.Start();
         }
     };
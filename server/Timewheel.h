@@ -147,6 +147,19 @@ namespace my_muduo
             _timer_channel->EnableRead();
         }
 
+        /* 时间轮析构时不再执行还没有到期的定时任务，所属的EventLoop已经不再运行了 */
+        ~TimerWheel()
+        {
+            for (auto &it : _timers)
+            {
+                PtrTask pt = it.second.lock();
+                if (pt)
+                    pt->Cancel();
+            }
+            _wheel.clear();
+            close(_timerfd);
+        }
+
         /* 定时器中有个_timers成员，定时器信息的操作有可能在多线程中仅需，因此需要考虑线程安全的问题 */
         /* 如果不想加锁，那就把定期的所有操作，都放到同一个线程中进行 */
         void TimerAdd(uint64_t id, uint32_t delay, const TaskFunc &cb);
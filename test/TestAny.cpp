@@ -1,4 +1,9 @@
 #include "Any.h"
+#include <string>
+#include <memory>
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
 
 using namespace my_muduo;
 
@@ -7,9 +12,16 @@ class Test
 public:
     Test() { std::cout << "construct" << std::endl; }
     Test(const Test &t) { std::cout << "copy construct" << std::endl; }
+    Test(Test &&t) noexcept { std::cout << "move construct" << std::endl; }
     ~Test() { std::cout << "disconstruct" << std::endl; }
 };
 
+// 超过内联存储大小，保存在堆上
+struct Big
+{
+    char data[128];
+};
+
 int main()
 {
     Any a;
@@ -23,4 +35,40 @@ int main()
     a = std::string("nihao");
     std::string *ps = a.get<std::string>();
     std::cout << *ps << std::endl;
-}
\ No newline at end of file
+
+    // 原地构造，不产生临时对象
+    a.emplace<Test>();
+    std::cout << "is Test: " << a.is<Test>() << " is int: " << a.is<int>() << std::endl;
+
+    // 拷贝与移动
+    Any b(a);
+    Any c(std::move(b));
+    std::cout << "moved-from empty: " << b.empty() << std::endl;
+
+    Any big = Big{"big"};
+    Any big2 = big;
+    big2.swap(a);
+    std::cout << big2.is<Test>() << " " << a.get<Big>()->data << std::endl;
+
+    // 不可拷贝的类型只能移动
+    Any u;
+    u.emplace<std::unique_ptr<int>>(new int(5));
+    Any u2(std::move(u));
+    std::cout << **u2.get<std::unique_ptr<int>>() << std::endl;
+    // 拷贝只能移动的类型时终止进程，定义NDEBUG时也一样
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        Any copy(u2);
+        exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    std::cout << "copy move-only aborted: " << (WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT) << std::endl;
+
+    // 赋值的值引用当前保存的数据
+    a = std::string("self");
+    a = *a.get<std::string>();
+    std::cout << *a.get<std::string>() << std::endl;
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include "BinLog.h"
+
+using namespace my_muduo;
+
+// 各种参数类型的还原结果应与printf一致
+void testformat()
+{
+    char arr[8] = "arr";
+    const char *cstr = "cstr";
+    BLOGI("int %d uint %u hex %#x ll %lld dbl %.3f str %-6s| %s %s ptr %p pct %% chr %c neg %5d|",
+          -3, 7u, 255, 1LL << 40, 3.14159, "lit", cstr, arr, (void *)cstr, 'A', -2);
+    BLOGW("no args");
+    BLOGD("size %zu", sizeof(arr));
+    binlg.Stop();
+}
+
+// 写日志线程的耗时：二进制日志与文本日志对比
+void testbench(int lines)
+{
+    lg.SetLogFile("./binlog.txt");
+    EnableFILE();
+    for (int round = 0; round < 2; round++)
+    {
+        std::atomic<int64_t> total_ns(0);
+        std::vector<std::thread> threads;
+        for (int k = 0; k < 4; k++)
+        {
+            threads.emplace_back([=, &total_ns]() {
+                // 每批250行后休眠，总速率控制在每秒100万行左右，避免环形缓冲区写满；只统计写日志的耗时
+                for (int i = 0; i < lines; i += 250)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    for (int j = i; j < i + 250; j++)
+                    {
+                        if (round == 0)
+                            BLOGI("GET %s status %d bytes %d conn %d", "/index.html", 200, j, k);
+                        else
+                            LOGI("GET %s status %d bytes %d conn %d", "/index.html", 200, j, k);
+                    }
+                    total_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                    std::this_thread::sleep_for(std::chrono::microseconds(900));
+                }
+            });
+        }
+        for (auto &t : threads)
+            t.join();
+        std::cout << (round == 0 ? "binlog: " : "text log: ") << total_ns / (4.0 * lines) << " ns/line" << std::endl;
+    }
+}
+
+int main()
+{
+    testformat();
+    testbench(500000);
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "HTTPCompress.h"
+#include <iostream>
+#include <chrono>
+
+using namespace my_muduo;
+
+// windowBits 加32自动识别gzip和zlib格式
+static std::string Inflate(const std::string &data)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    assert(inflateInit2(&zs, 15 + 32) == Z_OK);
+    std::string out(data.size() * 20 + 1024, '\0');
+    zs.next_in = (Bytef *)data.data();
+    zs.avail_in = data.size();
+    zs.next_out = (Bytef *)&out[0];
+    zs.avail_out = out.size();
+    int ret = inflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    inflateEnd(&zs);
+    assert(ret == Z_STREAM_END);
+    return out;
+}
+
+static std::string Text(size_t size)
+{
+    std::string text;
+    for (size_t i = 0; text.size() < size; i++)
+        text += "{\"id\":" + std::to_string(i) + ",\"name\":\"item\"},";
+    text.resize(size);
+    return text;
+}
+
+void testcomplete()
+{
+    std::string text = Text(100000), out;
+    for (CompressType type : {COMPRESS_GZIP, COMPRESS_DEFLATE})
+    {
+        assert(DeflaterPool::Compress(type, text, &out));
+        assert(out.size() < text.size() / 4 && Inflate(out) == text);
+        // gzip以1f 8b开头，zlib以78开头
+        assert(type == COMPRESS_GZIP ? (unsigned char)out[0] == 0x1f : (unsigned char)out[0] == 0x78);
+    }
+    // 用过的压缩器重置后放回池中，下次取到的是同一个
+    std::unique_ptr<Deflater> a = DeflaterPool::Get(COMPRESS_GZIP);
+    Deflater *p = a.get();
+    DeflaterPool::Put(std::move(a));
+    assert(DeflaterPool::Get(COMPRESS_GZIP).get() == p);
+    assert(DeflaterPool::Compress(COMPRESS_GZIP, "", &out) && Inflate(out).empty());
+    std::cout << "complete ok" << std::endl;
+}
+
+void teststream()
+{
+    std::string text = Text(50000), out;
+    std::unique_ptr<Deflater> deflater = DeflaterPool::Get(COMPRESS_GZIP);
+    for (size_t i = 0; i < text.size(); i += 4096)
+    {
+        size_t before = out.size();
+        assert(deflater->Update(text.data() + i, std::min<size_t>(4096, text.size() - i), &out, true));
+        // 每块flush之后都有输出，客户端可以立即解压
+        assert(out.size() > before);
+    }
+    assert(deflater->Finish(&out));
+    assert(Inflate(out) == text);
+    DeflaterPool::Put(std::move(deflater));
+    std::cout << "stream ok, " << text.size() << " -> " << out.size() << std::endl;
+}
+
+void testbench(int count)
+{
+    std::string text = Text(8192), out;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+    {
+        Deflater deflater(COMPRESS_GZIP);
+        out.clear();
+        deflater.Update(text.data(), text.size(), &out);
+        deflater.Finish(&out);
+    }
+    double init_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / count;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+        DeflaterPool::Compress(COMPRESS_GZIP, text, &out);
+    double pool_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / count;
+    std::cout << "8KB json, new deflater: " << init_us << " us, pooled: " << pool_us << " us" << std::endl;
+}
+
+int main()
+{
+    testcomplete();
+    teststream();
+    testbench(2000);
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include "FileCache.h"
+#include <unistd.h>
+#include <ftw.h>
+#include <chrono>
+
+using namespace my_muduo;
+
+// 每次运行使用新建的临时目录，结束时删除，残留的文件（比如d.js.br）不会影响下一次运行
+static std::string dir;
+
+static int RemoveEntry(const char *path, const struct stat *, int, struct FTW *)
+{
+    return remove(path);
+}
+
+static std::string Body(OpenFileCache &files, FileCache &cache, const std::string &path)
+{
+    std::shared_ptr<const OpenFile> file;
+    if (files.Lookup(path, &file) == false)
+        return "<none>";
+    std::shared_ptr<const FileEntry> entry = cache.Lookup(*file);
+    return entry ? *entry->body : "<uncached>";
+}
+
+void testopenfile()
+{
+    std::string a = dir + "/a.html";
+    Util::WriteFile(a, "hello");
+
+    OpenFileCache files(2, 50, 1000);
+    std::shared_ptr<const OpenFile> file, again;
+    assert(files.Lookup(a, &file) && file->fd >= 0 && file->st.st_size == 5);
+    assert(file->headers.compare(0, 44, "Content-Type: text/html\r\nContent-Length: 5\r\n") == 0);
+    // 校验间隔内直接返回同一个描述符
+    assert(files.Lookup(a, &again) && again == file);
+    // 过了校验间隔文件没有变化，继续使用原来的描述符
+    usleep(60 * 1000);
+    assert(files.Lookup(a, &again) && again == file);
+    assert(files.Hits() == 2 && files.Misses() == 1);
+
+    // 文件被替换后重新打开，旧的描述符在引用释放之前仍然可用
+    Util::WriteFile(dir + "/a.tmp", "hello world");
+    rename((dir + "/a.tmp").c_str(), a.c_str());
+    usleep(60 * 1000);
+    assert(files.Lookup(a, &again) && again != file && again->st.st_size == 11);
+    char buf[8] = {0};
+    assert(pread(file->fd, buf, 5, 0) == 5 && std::string(buf) == "hello");
+
+    // 超过个数上限时淘汰最久未使用的
+    Util::WriteFile(dir + "/b.txt", "b");
+    Util::WriteFile(dir + "/c.txt", "c");
+    assert(files.Lookup(dir + "/b.txt", &file) && files.Lookup(dir + "/c.txt", &file));
+    assert(files.Count() == 2);
+
+    // 预压缩文件与原文件一起打开，新增预压缩文件在校验时发现
+    Util::WriteFile(dir + "/d.js", "var d;");
+    Util::WriteFile(dir + "/d.js.gz", "gz");
+    assert(files.Lookup(dir + "/d.js", &file) && file->vary);
+    assert(file->encoded[ENCODING_GZIP] && file->encoded[ENCODING_BR] == nullptr);
+    assert(file->encoded[ENCODING_GZIP]->encoding == "gzip" && file->encoded[ENCODING_GZIP]->mime == file->mime);
+    Util::WriteFile(dir + "/d.js.br", "br");
+    usleep(60 * 1000);
+    assert(files.Lookup(dir + "/d.js", &file) && file->encoded[ENCODING_BR]);
+
+    assert(files.Lookup(dir, &file) == false);
+    assert(files.Lookup(dir + "/nope", &file) == false);
+    std::cout << "open file ok, hits " << files.Hits() << " misses " << files.Misses() << std::endl;
+}
+
+void testcache()
+{
+    std::string a = dir + "/a.html", b = dir + "/b.txt";
+    Util::WriteFile(a, "hello");
+    Util::WriteFile(b, std::string(420, 'b'));
+
+    OpenFileCache files(16, 0);
+    FileCache cache(1200);
+    assert(Body(files, cache, a) == "hello");
+    assert(Body(files, cache, a) == "hello");
+    assert(cache.Hits() == 1 && cache.Misses() == 1);
+
+    // 文件修改后重新读取
+    Util::WriteFile(a, "hello world");
+    assert(Body(files, cache, a) == "hello world");
+
+    // 超过内存上限时淘汰最久未使用的
+    assert(Body(files, cache, b) == std::string(420, 'b'));
+    Util::WriteFile(dir + "/c.txt", std::string(420, 'c'));
+    assert(Body(files, cache, dir + "/c.txt") == std::string(420, 'c'));
+    assert(cache.Count() == 2 && cache.Bytes() <= 1200);
+
+    // 关闭内容缓存后只返回打开的文件
+    cache.Config(0);
+    assert(Body(files, cache, b) == "<uncached>" && cache.Count() == 0);
+    std::cout << "cache ok, hits " << cache.Hits() << " misses " << cache.Misses() << std::endl;
+}
+
+void testbench(int count)
+{
+    std::string path = dir + "/index.html";
+    Util::WriteFile(path, std::string(4096, 'x'));
+    OpenFileCache files;
+    FileCache cache;
+    size_t total = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+    {
+        std::string body;
+        Util::IsRegular(path);
+        Util::ReadFile(path, &body);
+        total += body.size();
+    }
+    double read_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+    {
+        std::shared_ptr<const OpenFile> file;
+        files.Lookup(path, &file);
+        total += cache.Lookup(*file)->body->size();
+    }
+    double cache_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+    std::cout << "4KB file, stat+read: " << read_ns << " ns, cache: " << cache_ns << " ns " << total << std::endl;
+}
+
+int main()
+{
+    char tmpl[] = "/tmp/filecache_test.XXXXXX";
+    if (mkdtemp(tmpl) == nullptr)
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    dir = tmpl;
+    testopenfile();
+    testcache();
+    testbench(100000);
+    nftw(dir.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include "HTTPParser.h"
+#include <iostream>
+#include <string>
+#include <regex>
+#include <chrono>
+#include <cassert>
+#include <unordered_map>
+
+using namespace my_muduo;
+
+static const std::string request =
+    "GET /index.html?user=xiaoming&pass=123123 HTTP/1.1\r\n"
+    "Host: 127.0.0.1:8085\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+// 原来HTTPContext中基于正则的解析方式，作为对比
+struct RegexRequest
+{
+    std::string method, path, query, version;
+    std::unordered_map<std::string, std::string> headers;
+};
+
+static bool RegexParse(const std::string &data, RegexRequest *req)
+{
+    size_t pos = data.find('\n');
+    std::string line = data.substr(0, pos + 1);
+    std::smatch matches;
+    std::regex e("(GET|HEAD|POST|PUT|DELETE) ([^?]*)(?:\\?(.*))? (HTTP/1\\.[01])(?:\n|\r\n)?", std::regex::icase);
+    if (std::regex_match(line, matches, e) == false)
+        return false;
+    req->method = matches[1];
+    req->path = matches[2];
+    req->query = matches[3];
+    req->version = matches[4];
+    size_t start = pos + 1;
+    while (true)
+    {
+        pos = data.find('\n', start);
+        std::string head = data.substr(start, pos + 1 - start);
+        start = pos + 1;
+        if (head == "\n" || head == "\r\n")
+            break;
+        head.pop_back();
+        if (head.back() == '\r')
+            head.pop_back();
+        size_t sep = head.find(": ");
+        if (sep == std::string::npos)
+            return false;
+        req->headers.insert({head.substr(0, sep), head.substr(sep + 2)});
+    }
+    return true;
+}
+
+static std::string SliceStr(const std::string &data, HTTPSlice s) { return data.substr(s.off, s.len); }
+
+// 在任意字节处截断的数据都应该得到相同的结果
+void testincremental()
+{
+    for (size_t step = 1; step <= request.size(); step++)
+    {
+        HTTPParser parser;
+        HttpParseResult ret = PARSE_AGAIN;
+        for (size_t len = step; ret == PARSE_AGAIN; len += step)
+            ret = parser.Execute(request.data(), std::min(len, request.size()));
+        assert(ret == PARSE_DONE);
+        assert(parser.HeadLength() == request.size());
+        assert(SliceStr(request, parser.Method()) == "GET");
+        assert(SliceStr(request, parser.Path()) == "/index.html");
+        assert(SliceStr(request, parser.Query()) == "user=xiaoming&pass=123123");
+        assert(SliceStr(request, parser.Version()) == "HTTP/1.1");
+        assert(parser.HeaderCount() == 7);
+        assert(SliceStr(request, parser.Header(6).name) == "Content-Length");
+        assert(parser.ContentLength() == 0);
+    }
+    std::cout << "incremental ok" << std::endl;
+}
+
+static int ErrorOf(const std::string &data)
+{
+    HTTPParser parser;
+    if (parser.Execute(data.data(), data.size()) != PARSE_ERROR)
+        return 0;
+    return parser.ErrorStatu();
+}
+
+void testerror()
+{
+    assert(ErrorOf("GET /a HTTP/1.1\r\nHost: x\r\n\r\n") == 0);
+    assert(ErrorOf("\r\nGET /a HTTP/1.1\nHost:x\n\n") == 0);
+    assert(ErrorOf("G(T /a HTTP/1.1\r\n\r\n") == 400);
+    assert(ErrorOf("GET /a\x01 HTTP/1.1\r\n\r\n") == 400);
+    assert(ErrorOf("GET /a HTTP/2.0\r\n\r\n") == 505);
+    assert(ErrorOf("GET /a HTTX/1.1\r\n\r\n") == 400);
+    assert(ErrorOf("GET /a HTTP/1.1\r\n folded\r\n\r\n") == 400);
+    assert(ErrorOf("GET /a HTTP/1.1\r\nHost : x\r\n\r\n") == 400);
+    assert(ErrorOf("GET /a HTTP/1.1\r\nContent-Length: 1x\r\n\r\n") == 400);
+    assert(ErrorOf("GET /a HTTP/1.1\r\nContent-Length: 1\r\ncontent-length: 2\r\n\r\n") == 400);
+    assert(ErrorOf("GET /" + std::string(MAX_LINE, 'a') + " HTTP/1.1\r\n\r\n") == 414);
+    assert(ErrorOf("GET /a HTTP/1.1\r\nX: " + std::string(MAX_LINE, 'a') + "\r\n\r\n") == 431);
+    std::string many = "GET /a HTTP/1.1\r\n";
+    for (int i = 0; i <= MAX_HEADERS; i++)
+        many += "X: y\r\n";
+    assert(ErrorOf(many + "\r\n") == 431);
+    std::cout << "error ok" << std::endl;
+}
+
+void testbench(int count)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t check = 0;
+    for (int i = 0; i < count; i++)
+    {
+        RegexRequest req;
+        RegexParse(request, &req);
+        check += req.headers.size();
+    }
+    double regex_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+
+    start = std::chrono::steady_clock::now();
+    HTTPParser parser;
+    for (int i = 0; i < count; i++)
+    {
+        parser.Reset();
+        parser.Execute(request.data(), request.size());
+        check += parser.HeaderCount();
+    }
+    double parser_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+    std::cout << "regex: " << regex_ns << " ns/request, parser: " << parser_ns << " ns/request ("
+              << regex_ns / parser_ns << "x) " << check << std::endl;
+}
+
+int main()
+{
+    testincremental();
+    testerror();
+    testbench(20000);
+    return 0;
+}
@@ -0,0 +1,83 @@
+// 流水线请求的测试：异步GET后面跟一个POST，POST的头部先到达并在排队时停下，
+// 等待期间到达的大块正文使输入缓冲区扩容，之后处理POST时头部的各个字段仍然正确
+
+#include "HTTPServer.h"
+#include <sys/wait.h>
+#include <thread>
+
+using namespace my_muduo;
+
+#define PORT 8090
+#define BODY_SIZE (256 << 10)
+
+pid_t StartServer()
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        static HTTPServer server(PORT);
+        server.SetThreadCount(1);
+        // 异步应答在POST的正文全部到达之后才完成
+        server.GetAsync("/slow", [](const PtrResponder &r) {
+            std::thread([r]() {
+                usleep(500 * 1000);
+                r->Response()->SetContent("slow", "text/plain");
+                r->Done();
+            }).detach();
+        });
+        server.Post("/echo", [](const HTTPRequest &req, HTTPResponse *rsp) {
+            size_t sum = 0;
+            for (auto c : req._body)
+                sum += (unsigned char)c;
+            rsp->SetContent(req.GetHeader("X-Tag") + " " + std::to_string(req._body.size()) + " " + std::to_string(sum), "text/plain");
+        });
+        server.Listen();
+        exit(0);
+    }
+    return pid;
+}
+
+int main()
+{
+    pid_t server = StartServer();
+    usleep(300 * 1000);
+    Sock sock;
+    assert(sock.CreateClient(PORT, "127.0.0.1"));
+
+    std::string body(BODY_SIZE, '\0');
+    size_t sum = 0;
+    for (size_t i = 0; i < body.size(); i++)
+    {
+        body[i] = 'a' + i % 26;
+        sum += (unsigned char)body[i];
+    }
+    std::string head = "GET /slow HTTP/1.1\r\nHost: test\r\n\r\n"
+                       "POST /echo HTTP/1.1\r\nHost: test\r\nX-Tag: pipelined-post\r\nContent-Length: " +
+                       std::to_string(BODY_SIZE) + "\r\n\r\n";
+    assert(sock.Send(head.data(), head.size()) == (ssize_t)head.size());
+    // 头部先解析完，POST排在异步应答之后等待，正文随后到达
+    usleep(200 * 1000);
+    for (size_t off = 0; off < body.size();)
+    {
+        ssize_t ret = sock.Send(body.data() + off, body.size() - off);
+        assert(ret > 0);
+        off += ret;
+    }
+
+    std::string expect = "pipelined-post " + std::to_string(BODY_SIZE) + " " + std::to_string(sum);
+    std::string data;
+    char buf[4096];
+    while (data.find(expect) == std::string::npos)
+    {
+        ssize_t ret = sock.Recv(buf, sizeof(buf));
+        if (ret <= 0)
+            break;
+        data.append(buf, ret);
+    }
+    kill(server, SIGKILL);
+    waitpid(server, nullptr, 0);
+    size_t slow = data.find("\r\n\r\nslow"), echo = data.find(expect);
+    LOGI("slow at %ld, echo at %ld", (long)slow, (long)echo);
+    assert(slow != std::string::npos && echo != std::string::npos && slow < echo);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include "HTTPRouter.h"
+#include <chrono>
+
+using namespace my_muduo;
+
+static std::string hit;
+
+static HTTPRouter::Handler Mark(const std::string &name)
+{
+    return [name](const HTTPRequest &, HTTPResponse *) { hit = name; };
+}
+
+// 查找path，返回命中的处理函数名称或者状态码
+static std::string Lookup(HTTPRouter &router, HttpMethod method, const std::string &path, HTTPRequest *req = nullptr)
+{
+    HTTPRequest tmp;
+    if (req == nullptr)
+        req = &tmp;
+    req->_path = path;
+    int statu = 0;
+    std::string allow;
+    const HTTPRouter::Handler *handler = router.Find(method, *req, &statu, &allow);
+    if (handler == nullptr)
+        return std::to_string(statu) + (allow.empty() ? "" : " " + allow);
+    (*handler)(*req, nullptr);
+    return hit;
+}
+
+void testmatch()
+{
+    HTTPRouter router;
+    router.Add(HTTP_GET, "/", Mark("root"));
+    router.Add(HTTP_GET, "/user", Mark("user"));
+    router.Add(HTTP_GET, "/users", Mark("users"));
+    router.Add(HTTP_GET, "/user/new", Mark("user_new"));
+    router.Add(HTTP_GET, "/user/:id<int>", Mark("user_id"));
+    router.Add(HTTP_DELETE, "/user/:id<int>", Mark("user_del"));
+    router.Add(HTTP_GET, "/user/:id<int>/posts/:post", Mark("user_post"));
+    router.Add(HTTP_GET, "/static/*file", Mark("static"));
+    router.Add(HTTP_GET, "/team/:name/*rest", Mark("team_rest"));
+    router.Add(HTTP_GET, "/team/:name/info", Mark("team_info"));
+
+    assert(Lookup(router, HTTP_GET, "/") == "root");
+    assert(Lookup(router, HTTP_GET, "/user") == "user");
+    assert(Lookup(router, HTTP_GET, "/users") == "users");
+    assert(Lookup(router, HTTP_GET, "/user/new") == "user_new");
+    assert(Lookup(router, HTTP_HEAD, "/user/new") == "user_new");
+    HTTPRequest req;
+    assert(Lookup(router, HTTP_GET, "/user/-42", &req) == "user_id");
+    assert(req.PathParam("id") == "-42");
+    assert(Lookup(router, HTTP_GET, "/user/abc") == "404");
+    assert(Lookup(router, HTTP_GET, "/user/7/posts/hello", &req) == "user_post");
+    assert(req.PathParam("id") == "7" && req.PathParam("post") == "hello");
+    assert(Lookup(router, HTTP_GET, "/static/css/a.css", &req) == "static");
+    assert(req.PathParam("file") == "css/a.css");
+    assert(Lookup(router, HTTP_GET, "/team/red/info") == "team_info");
+    assert(Lookup(router, HTTP_GET, "/team/red/a/b", &req) == "team_rest");
+    assert(req.PathParam("name") == "red" && req.PathParam("rest") == "a/b");
+    assert(Lookup(router, HTTP_POST, "/user/1") == "405 GET, DELETE");
+    assert(Lookup(router, HTTP_GET, "/nothing") == "404");
+    std::cout << "match ok" << std::endl;
+}
+
+// 300条路由时，未命中路径的查找耗时：正则列表与前缀树对比
+void testbench(int count)
+{
+    HTTPRouter router;
+    std::vector<std::pair<std::regex, HTTPRouter::Handler>> regexes;
+    for (int i = 0; i < 300; i++)
+    {
+        std::string base = "/api/v1/module" + std::to_string(i);
+        router.Add(HTTP_GET, base + "/items/:id<int>", Mark("item"));
+        regexes.push_back({std::regex(base + "/items/(\\d+)"), Mark("item")});
+    }
+    HTTPRequest req;
+    req._path = "/api/v1/unknown/items/12345";
+
+    auto start = std::chrono::steady_clock::now();
+    size_t miss = 0;
+    for (int i = 0; i < count; i++)
+    {
+        bool found = false;
+        for (auto &route : regexes)
+        {
+            if (std::regex_match(req._path, req._matches, route.first))
+            {
+                found = true;
+                break;
+            }
+        }
+        miss += found ? 0 : 1;
+    }
+    double regex_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count * 100; i++)
+    {
+        int statu;
+        miss += router.Find(HTTP_GET, req, &statu) == nullptr ? 1 : 0;
+    }
+    double tree_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (count * 100);
+    std::cout << "404 lookup with 300 routes, regex: " << regex_ns << " ns, radix tree: " << tree_ns << " ns " << miss << std::endl;
+}
+
+int main()
+{
+    testmatch();
+    testbench(1000);
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "HTTPMultipart.h"
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <map>
+
+using namespace my_muduo;
+
+static const std::string boundary = "----WebKitFormBoundary7MA4YWxkTrZu0gW";
+
+struct Collected
+{
+    std::map<std::string, std::string> bodies; // name -> 正文
+    std::map<std::string, std::string> files;  // name -> filename
+    int finished = 0;
+};
+
+static std::shared_ptr<HTTPMultipart> Parser(Collected *out)
+{
+    return std::make_shared<HTTPMultipart>(boundary, [out](const MultipartPart &part) {
+        std::string *body = &out->bodies[part.name];
+        if (part.IsFile())
+            out->files[part.name] = part.filename;
+        return std::make_shared<HTTPBodySink>(
+            [body](const char *data, size_t len) { body->append(data, len); return true; },
+            [out]() { out->finished++; return true; });
+    });
+}
+
+static std::string Form(const std::string &file)
+{
+    std::string form = "preamble\r\n--" + boundary + "\r\n";
+    form += "Content-Disposition: form-data; name=\"title\"\r\n\r\nhello\r\n--world\r\n";
+    form += "--" + boundary + "\r\n";
+    form += "Content-Disposition: form-data; name=\"empty\"\r\n\r\n\r\n";
+    form += "--" + boundary + "\r\n";
+    form += "Content-Disposition: form-data; name=\"upload\"; filename=\"a \\\"b\\\".bin\"\r\nContent-Type: application/octet-stream\r\n\r\n";
+    form += file + "\r\n--" + boundary + "--\r\nepilogue";
+    return form;
+}
+
+// 随机位置切分输入，结果和一次输入完全相同
+void testsplit()
+{
+    std::mt19937 rng(1);
+    std::string file(100000, '\0');
+    for (auto &c : file)
+        c = "\r\n-ab"[rng() % 5]; // 大量分隔符前缀的干扰
+    std::string form = Form(file);
+    for (int round = 0; round < 200; round++)
+    {
+        Collected out;
+        std::shared_ptr<HTTPMultipart> parser = Parser(&out);
+        size_t max_step = round < 100 ? round + 1 : rng() % 100000 + 1;
+        for (size_t i = 0; i < form.size();)
+        {
+            size_t n = std::min<size_t>(rng() % max_step + 1, form.size() - i);
+            assert(parser->Feed(form.data() + i, n));
+            i += n;
+        }
+        assert(parser->Finish() && parser->PartCount() == 3 && out.finished == 3);
+        assert(out.bodies["title"] == "hello\r\n--world" && out.bodies["empty"].empty());
+        assert(out.bodies["upload"] == file && out.files["upload"] == "a \"b\".bin");
+    }
+    std::cout << "split ok" << std::endl;
+}
+
+void testerror()
+{
+    Collected out;
+    std::string form = Form("abc");
+    // 没有结束分隔符
+    std::shared_ptr<HTTPMultipart> parser = Parser(&out);
+    assert(parser->Feed(form.data(), form.size() - 20) && parser->Finish() == false);
+    // 头部格式错误
+    parser = Parser(&out);
+    std::string bad = "--" + boundary + "\r\nno colon\r\n\r\n";
+    assert(parser->Feed(bad.data(), bad.size()) == false);
+    std::string b;
+    assert(HTTPMultipart::Boundary("multipart/form-data; boundary=\"x y\"", &b) && b == "x y");
+    assert(HTTPMultipart::Boundary("Multipart/form-data;boundary=abc; charset=utf-8", &b) && b == "abc");
+    assert(HTTPMultipart::Boundary("application/json", &b) == false);
+    std::cout << "error ok" << std::endl;
+}
+
+void testbench()
+{
+    std::string file(50 << 20, 'x');
+    std::string form = Form(file);
+    size_t total = 0;
+    std::shared_ptr<HTTPMultipart> parser = std::make_shared<HTTPMultipart>(boundary, [&total](const MultipartPart &) {
+        return std::make_shared<HTTPBodySink>([&total](const char *, size_t len) { total += len; return true; });
+    });
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < form.size(); i += 65536)
+        parser->Feed(form.data() + i, std::min<size_t>(65536, form.size() - i));
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    assert(parser->Finish() && total == file.size() + 14);
+    std::cout << "50MB form: " << ms << " ms, " << file.size() / ms / 1000 << " MB/s" << std::endl;
+}
+
+int main()
+{
+    testsplit();
+    testerror();
+    testbench();
+    return 0;
+}
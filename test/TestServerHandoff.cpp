@@ -0,0 +1,88 @@
+// 不停机重启测试：旧进程运行期间启动新进程，新进程通过交接套接字继承监听套接字
+// 多个客户端持续建立短连接发送数据，整个重启过程中不应该出现连接被拒绝或者没有收到响应的情况
+
+#include "TCPServer.h"
+#include <sys/wait.h>
+
+using namespace my_muduo;
+
+#define PORT 8087
+#define HANDOFF_PATH "/tmp/my_muduo_handoff.sock"
+#define CLIENT_COUNT 4
+#define CLIENT_SECONDS 4
+
+void OnMessage(const PtrConnection &conn, Buffer *buf)
+{
+    conn->Send(buf->ReadPosition(), buf->ReadAbleSize());
+    buf->MoveReadOffset(buf->ReadAbleSize());
+    conn->ShutDown();
+}
+
+pid_t StartServer()
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        TCPServer server(PORT, HANDOFF_PATH);
+        server.SetThreadCount(2);
+        server.SetHandoffGrace(3);
+        server.SetMessageCallBack(OnMessage);
+        server.Start();
+        LOGI("server %d exit", getpid());
+        exit(0);
+    }
+    return pid;
+}
+
+pid_t StartClient()
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int total = 0, failed = 0;
+        time_t end = time(nullptr) + CLIENT_SECONDS;
+        while (time(nullptr) < end)
+        {
+            total++;
+            Sock cli_sock;
+            if (cli_sock.CreateClient(PORT, "127.0.0.1") == false)
+            {
+                failed++;
+                continue;
+            }
+            char buf[64] = {0};
+            if (cli_sock.Send("hello", 5) != 5 || cli_sock.Recv(buf, 63) != 5)
+                failed++;
+        }
+        LOGI("client %d: total %d, failed %d", getpid(), total, failed);
+        exit(failed == 0 ? 0 : 1);
+    }
+    return pid;
+}
+
+int main()
+{
+    pid_t old_server = StartServer();
+    usleep(500 * 1000);
+    std::vector<pid_t> clients;
+    for (int i = 0; i < CLIENT_COUNT; i++)
+        clients.push_back(StartClient());
+    sleep(1);
+    pid_t new_server = StartServer();
+
+    int failed = 0;
+    for (auto &pid : clients)
+    {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (WIFEXITED(status) == false || WEXITSTATUS(status) != 0)
+            failed++;
+    }
+    // 旧进程交出监听套接字后，处理完已有连接应该自己退出
+    int status = 0;
+    waitpid(old_server, &status, 0);
+    kill(new_server, SIGTERM);
+    waitpid(new_server, &status, 0);
+    LOGI("%d clients failed", failed);
+    return failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,101 @@
+// 迁移期间的发送顺序测试：一个线程不停地发送递增的序号，另一个线程同时把连接在两个loop之间来回迁移，
+// 客户端收到的序号必须连续递增，迁移前后投递的发送任务不能乱序
+
+#include "TCPServer.h"
+#include <sys/wait.h>
+#include <thread>
+
+using namespace my_muduo;
+
+#define PORT 8091
+#define SEND_COUNT 200000
+#define MIGRATE_COUNT 20000
+
+std::mutex mtx;
+std::vector<PtrConnection> conns;
+
+void OnConnected(const PtrConnection &conn)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    conns.push_back(conn);
+}
+
+// 第一个连接收到数据后开始测试，第二个连接只用来拿到另一个loop
+void OnMessage(const PtrConnection &conn, Buffer *buf)
+{
+    buf->MoveReadOffset(buf->ReadAbleSize());
+    std::unique_lock<std::mutex> lock(mtx);
+    if (conns.size() < 2 || conn != conns[0])
+        return;
+    EventLoop *a = conns[0]->GetLoop(), *b = conns[1]->GetLoop();
+    std::thread([conn]() {
+        for (int i = 0; i < SEND_COUNT; i++)
+        {
+            std::string line = std::to_string(i) + "\n";
+            conn->Send(line.c_str(), line.size());
+        }
+    }).detach();
+    std::thread([conn, a, b]() {
+        for (int i = 0; i < MIGRATE_COUNT; i++)
+        {
+            conn->MigrateTo(i % 2 ? a : b);
+            usleep(10);
+        }
+    }).detach();
+}
+
+pid_t StartServer()
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        static TCPServer server(PORT);
+        server.SetThreadCount(2);
+        server.SetConnectionCallBack(OnConnected);
+        server.SetMessageCallBack(OnMessage);
+        server.Start();
+        exit(0);
+    }
+    return pid;
+}
+
+int main()
+{
+    pid_t server = StartServer();
+    usleep(300 * 1000);
+    Sock cli_sock, other;
+    assert(cli_sock.CreateClient(PORT, "127.0.0.1"));
+    usleep(100 * 1000);
+    assert(other.CreateClient(PORT, "127.0.0.1"));
+    usleep(100 * 1000);
+    cli_sock.Send("go", 2);
+
+    std::string data;
+    char buf[65536];
+    int next = 0;
+    size_t pos = 0, nl;
+    bool ordered = true;
+    while (ordered && next < SEND_COUNT)
+    {
+        ssize_t ret = cli_sock.Recv(buf, sizeof(buf));
+        if (ret <= 0)
+            break;
+        data.append(buf, ret);
+        while (ordered && (nl = data.find('\n', pos)) != std::string::npos)
+        {
+            int seq = atoi(data.c_str() + pos);
+            if (seq != next)
+            {
+                LOGE("expect %d, got %d", next, seq);
+                ordered = false;
+            }
+            next++;
+            pos = nl + 1;
+        }
+    }
+    kill(server, SIGKILL);
+    waitpid(server, nullptr, 0);
+    LOGI("received %d of %d, %s", next, SEND_COUNT, ordered ? "in order" : "reordered");
+    assert(ordered && next == SEND_COUNT);
+    return 0;
+}
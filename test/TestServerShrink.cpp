@@ -0,0 +1,68 @@
+// 运行时一次回收多个从属线程的测试：4个线程缩减到1个，挂在被回收线程上的长连接全部迁移到留下的线程，
+// 超过等待时间之后所有连接仍然可以正常收发数据，不会被当作没有迁移走的连接释放
+
+#include "TCPServer.h"
+#include <sys/wait.h>
+
+using namespace my_muduo;
+
+#define PORT 8088
+#define CONN_COUNT 12
+#define DRAIN_GRACE 2
+
+void OnMessage(const PtrConnection &conn, Buffer *buf)
+{
+    conn->Send(buf->ReadPosition(), buf->ReadAbleSize());
+    buf->MoveReadOffset(buf->ReadAbleSize());
+}
+
+pid_t StartServer()
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        static TCPServer server(PORT);
+        server.SetThreadCount(4);
+        server.SetDrainGrace(DRAIN_GRACE);
+        server.SetMessageCallBack(OnMessage);
+        // 客户端连接全部建立之后一次回收3个线程
+        server.RunAfter([]() { server.SetThreadCount(1); }, 2);
+        server.Start();
+        exit(0);
+    }
+    return pid;
+}
+
+bool Echo(Sock &sock, int i)
+{
+    std::string msg = "hello " + std::to_string(i);
+    char buf[64] = {0};
+    return sock.Send(msg.c_str(), msg.size()) == (ssize_t)msg.size() && sock.Recv(buf, 63) == (ssize_t)msg.size() && msg == buf;
+}
+
+int main()
+{
+    pid_t server = StartServer();
+    usleep(500 * 1000);
+    std::vector<Sock> socks(CONN_COUNT);
+    for (int i = 0; i < CONN_COUNT; i++)
+    {
+        assert(socks[i].CreateClient(PORT, "127.0.0.1"));
+        assert(Echo(socks[i], i));
+    }
+    // 等待回收开始并超过等待时间，没有迁移走的连接这时已经被释放
+    sleep(2 + DRAIN_GRACE + 2);
+    int failed = 0;
+    for (int i = 0; i < CONN_COUNT; i++)
+    {
+        if (Echo(socks[i], i) == false)
+            failed++;
+    }
+    for (auto &sock : socks)
+        sock.Close();
+    kill(server, SIGKILL);
+    waitpid(server, nullptr, 0);
+    LOGI("connections: %d, failed after shrink: %d", CONN_COUNT, failed);
+    assert(failed == 0);
+    return 0;
+}